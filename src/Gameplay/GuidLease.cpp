@@ -0,0 +1,75 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "GuidLease.h"
+
+// lease bound to current thread
+static THREAD_LOCAL GuidLease* currentGuidLease = nullptr;
+
+GuidLease::GuidLease()
+{
+    for (uint32_t i = 0; i < MAX_GUIDMAP; i++)
+        m_count[i] = 0;
+}
+
+GuidLease::~GuidLease()
+{
+    Release();
+}
+
+void GuidLease::Bind()
+{
+    currentGuidLease = this;
+}
+
+void GuidLease::Release()
+{
+    if (currentGuidLease == this)
+        currentGuidLease = nullptr;
+
+    for (uint32_t i = 0; i < MAX_GUIDMAP; i++)
+    {
+        if (m_count[i] == 0)
+            continue;
+
+        sObjectAccessor->ReturnGUIDs((GUIDMapType)i, m_guids[i], m_count[i]);
+        m_count[i] = 0;
+    }
+}
+
+int64_t GuidLease::Use(GUIDMapType type)
+{
+    if (m_count[type] == 0)
+    {
+        m_count[type] = sObjectAccessor->LeaseGUIDs(type, m_guids[type], GUID_LEASE_SIZE);
+        if (m_count[type] == 0)
+            return -1;
+
+        // use GUIDs in ascending order, so they are taken from the end
+        std::reverse(m_guids[type], m_guids[type] + m_count[type]);
+    }
+
+    return m_guids[type][--m_count[type]];
+}
+
+GuidLease* GuidLease::GetCurrent()
+{
+    return currentGuidLease;
+}
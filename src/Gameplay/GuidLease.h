@@ -0,0 +1,59 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_GUIDLEASE_H
+#define BW_GUIDLEASE_H
+
+#include "ObjectAccessor.h"
+
+// count of GUIDs of every type reserved from guidspace at once
+#define GUID_LEASE_SIZE 64
+
+/*
+ * Class holding GUIDs reserved from global guidspace for one thread; the thread allocates GUIDs
+ * from its bound lease without any locking, and reserves another block only when the lease is exhausted;
+ * the lease has to be released before guidspace snapshot is saved, otherwise its unused GUIDs are stored as used
+ */
+class GuidLease
+{
+    public:
+        GuidLease();
+        ~GuidLease();
+
+        // binds lease to calling thread; GUIDs allocated by the thread are taken from this lease since now
+        void Bind();
+        // returns unused GUIDs to guidspace and unbinds lease if bound to calling thread
+        void Release();
+        // takes GUID of given type from lease, reserves another block when empty; returns -1 on failure
+        int64_t Use(GUIDMapType type);
+
+        // retrieves lease bound to calling thread, nullptr if none
+        static GuidLease* GetCurrent();
+
+    protected:
+        //
+
+    private:
+        // reserved GUIDs of every type, the ones to be used first are at the end
+        int64_t m_guids[MAX_GUIDMAP][GUID_LEASE_SIZE];
+        // count of GUIDs of every type still available in lease
+        uint32_t m_count[MAX_GUIDMAP];
+};
+
+#endif
@@ -28,16 +28,65 @@
 #include "MapStorage.h"
 #include "CreatureStorage.h"
 #include "GameobjectStorage.h"
+#include "ObjectAccessor.h"
+#include "Config.h"
 #include "Log.h"
 
-Map::Map(uint32_t id, MapRecord* mapTemplate) : m_mapId(id), m_storedMapRecord(mapTemplate)
+#include <sstream>
+
+// use SSE2 intrinsics for distance filtering, when available
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#define MAP_QUERY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+// position stored for objects pending cell removal; it never passes any range check
+#define MAP_CELL_STALE_POSITION -1.0e9f
+
+// retrieves visibility distance configured for map
+static float GetConfiguredVisibilityDistance(uint32_t mapId)
+{
+    int64_t distance = sConfig->GetIntValue(CONFIG_INT_MAP_VISIBILITY_DISTANCE);
+
+    // overrides are in format "mapId:distance,mapId:distance,..."
+    std::stringstream overrides(sConfig->GetStringValue(CONFIG_STRING_MAP_VISIBILITY_DISTANCE_OVERRIDES));
+    std::string item, mapStr, distStr;
+    int64_t overrideMap, overrideDistance;
+    size_t sep;
+
+    while (std::getline(overrides, item, ','))
+    {
+        sep = item.find(':');
+        if (sep == std::string::npos)
+            continue;
+
+        mapStr = item.substr(0, sep);
+        distStr = item.substr(sep + 1);
+
+        if (str2int(overrideMap, str_trim(mapStr).c_str()) && str2int(overrideDistance, str_trim(distStr).c_str()) && overrideMap == mapId)
+            distance = overrideDistance;
+    }
+
+    // it makes no sense to see further than cell sorroundings
+    if (distance <= 0 || distance > MAP_VISIBILITY_DISTANCE_MAX)
+        distance = MAP_VISIBILITY_DISTANCE_MAX;
+
+    return (float)distance;
+}
+
+Map::Map(uint32_t id, MapRecord* mapTemplate, uint32_t instanceId) : m_mapId(id), m_instanceId(instanceId), m_storedMapRecord(mapTemplate)
 {
-    //
+    m_visibilityDistance = GetConfiguredVisibilityDistance(id);
+    m_lastVisibilityRebuild = getMSTime();
+    m_playerCount = 0;
+    m_emptySince = getMSTime();
+    m_lastCellDespawnCheck = getMSTime();
+    m_snapshotIndex = 0;
 }
 
 Map::~Map()
 {
-    //
+    UnloadContents();
 }
 
 void Map::InitContents()
@@ -49,56 +98,222 @@ void Map::InitContents()
     uint32_t csizeX = GetCellIndexX((float)m_storedMapRecord->header.sizeX) + 1;
     uint32_t csizeY = GetCellIndexY((float)m_storedMapRecord->header.sizeY) + 1;
 
-    // resize object vectors
-    m_objects.resize(csizeX);
+    // resize cell grid
+    m_cells.resize(csizeX);
     for (uint32_t i = 0; i < csizeX; i++)
-        m_objects[i].resize(csizeY);
+        m_cells[i].resize(csizeY);
 
-    // prepare pathfinding layer
-    m_pathfindLayer.resize(m_storedMapRecord->header.sizeX);
-    for (uint32_t i = 0; i < m_storedMapRecord->header.sizeX; i++)
-        m_pathfindLayer[i].resize(m_storedMapRecord->header.sizeY);
+    // prepare pathfinding layer; base pages are shared with map template until modified
+    m_pathfindLayer.Init(m_storedMapRecord);
 
-    // fill base pathfinding map
-    for (uint32_t i = 0; i < m_storedMapRecord->header.sizeX; i++)
+    // chunks are loaded when the map touches them
+    m_referencedChunks.assign(m_storedMapRecord->chunks.size(), false);
+
+    uint32_t cx, cy;
+
+    // retrieve creature spawns and index them by cell; they are instantiated when a player gets near
+    CreatureSpawnList crList;
+    sCreatureStorage->GetCreatureSpawnsForMap(m_mapId, crList);
+
+    for (CreatureSpawnRecord& rec : crList)
     {
-        for (uint32_t j = 0; j < m_storedMapRecord->header.sizeY; j++)
+        cx = GetCellIndexX(rec.positionX);
+        cy = GetCellIndexY(rec.positionY);
+        if (rec.positionX < 0.0f || rec.positionY < 0.0f || cx >= csizeX || cy >= csizeY)
         {
-            MapField* fld = GetFieldAbs(i, j);
-            m_pathfindLayer[i][j].moveType = GetMovementTypeMaskFor(fld);
+            sLog->Error("Creature spawn (GUID: %u) on map %u lies outside the map", rec.guid, m_mapId);
+            continue;
         }
+
+        m_cells[cx][cy].creatureSpawns.push_back(rec);
     }
 
-    // retrieve creature spawns
-    CreatureSpawnList crList;
-    sCreatureStorage->GetCreatureSpawnsForMap(m_mapId, crList);
+    // retrieve gameobject spawns and index them by cell
+    GameobjectSpawnList goList;
+    sGameobjectStorage->GetGameobjectSpawnsForMap(m_mapId, goList);
 
-    // put creatures on map
+    for (GameobjectSpawnRecord& rec : goList)
+    {
+        cx = GetCellIndexX(rec.positionX);
+        cy = GetCellIndexY(rec.positionY);
+        if (rec.positionX < 0.0f || rec.positionY < 0.0f || cx >= csizeX || cy >= csizeY)
+        {
+            sLog->Error("Gameobject spawn (GUID: %u) on map %u lies outside the map", rec.guid, m_mapId);
+            continue;
+        }
+
+        m_cells[cx][cy].gameobjectSpawns.push_back(rec);
+    }
+}
+
+void Map::ActivateCellsAround(uint32_t cellX, uint32_t cellY)
+{
+    uint32_t beginX, endX, beginY, endY, itX, itY;
+    uint32_t now = getMSTime();
+
+    GetCellSorroundingLimits(cellX, cellY, beginX, beginY, endX, endY);
+
+    for (itX = beginX; itX <= endX; itX++)
+    {
+        for (itY = beginY; itY <= endY; itY++)
+        {
+            m_cells[itX][itY].lastActiveTime = now;
+
+            if (!m_cells[itX][itY].spawned)
+                SpawnCell(itX, itY);
+        }
+    }
+}
+
+void Map::SpawnCell(uint32_t cellX, uint32_t cellY)
+{
+    MapCell& cell = m_cells[cellX][cellY];
+
+    // mark it first, objects are added to map (and to this cell) during spawning
+    cell.spawned = true;
+
+    // put creatures on map; instances need their own GUIDs, spawn GUIDs are used by base map
     Creature* cr;
-    for (CreatureSpawnRecord& rec : crList)
+    for (CreatureSpawnRecord const& rec : cell.creatureSpawns)
     {
         cr = new Creature();
-        cr->Create(rec.guid, rec.id);
-        cr->SetInitialPositionAfterLoad(rec.positionMap, rec.positionX, rec.positionY);
+        cr->Create(IsInstance() ? EXTRACT_GUIDLOW(sObjectAccessor->AllocateCreatureGUID(rec.id)) : rec.guid, rec.id);
+        cr->SetInitialPositionAfterLoad(rec.positionMap, rec.positionX, rec.positionY, m_instanceId);
         cr->SetSpawnPosition(rec.positionX, rec.positionY);
+        cell.spawnedGuids.push_back(cr->GetGUID());
         AddToMap(cr);
     }
 
-    // retrieve gameobject spawns
-    GameobjectSpawnList goList;
-    sGameobjectStorage->GetGameobjectSpawnsForMap(m_mapId, goList);
-
     // put gameobjects on map
     Gameobject* go;
-    for (GameobjectSpawnRecord& rec : goList)
+    for (GameobjectSpawnRecord const& rec : cell.gameobjectSpawns)
     {
         go = new Gameobject();
-        go->Create(rec.guid, rec.id);
-        go->SetInitialPositionAfterLoad(rec.positionMap, rec.positionX, rec.positionY);
+        go->Create(IsInstance() ? EXTRACT_GUIDLOW(sObjectAccessor->AllocateGameobjectGUID(rec.id)) : rec.guid, rec.id);
+        go->SetInitialPositionAfterLoad(rec.positionMap, rec.positionX, rec.positionY, m_instanceId);
+        cell.spawnedGuids.push_back(go->GetGUID());
         AddToMap(go);
     }
 }
 
+void Map::DespawnCell(uint32_t cellX, uint32_t cellY)
+{
+    MapCell& cell = m_cells[cellX][cellY];
+    WorldObject* obj;
+    std::vector<uint64_t> keptGuids;
+
+    // spawned objects may have wandered to another cell, find them by GUID
+    for (uint64_t guid : cell.spawnedGuids)
+    {
+        obj = sObjectAccessor->FindWorldObject(guid);
+        if (!obj || obj->GetMap() != this)
+            continue;
+
+        // the object is near some player now, keep it until its current cell gets idle too
+        if (!IsCellIdle(GetCellIndexX(obj->GetPositionX()), GetCellIndexY(obj->GetPositionY())))
+        {
+            keptGuids.push_back(guid);
+            continue;
+        }
+
+        RemoveFromMap(obj);
+
+        // instance spawns have their GUIDs allocated, base map uses spawn GUIDs
+        sObjectAccessor->RetireObject(obj, IsInstance());
+    }
+
+    // the cell stays spawned while any of its objects exists, so they won't be spawned twice
+    cell.spawnedGuids.swap(keptGuids);
+    cell.spawned = !cell.spawnedGuids.empty();
+}
+
+bool Map::IsCellIdle(uint32_t cellX, uint32_t cellY)
+{
+    uint32_t despawnTime = (uint32_t)sConfig->GetIntValue(CONFIG_INT_MAP_CELL_DESPAWN_TIME) * 60 * 1000;
+    if (despawnTime == 0)
+        return false;
+
+    if (cellX >= m_cells.size() || cellY >= m_cells[cellX].size())
+        return true;
+
+    return getMSTimeDiff(m_cells[cellX][cellY].lastActiveTime, getMSTime()) >= despawnTime;
+}
+
+void Map::DespawnIdleCells()
+{
+    uint32_t despawnTime = (uint32_t)sConfig->GetIntValue(CONFIG_INT_MAP_CELL_DESPAWN_TIME) * 60 * 1000;
+    if (despawnTime == 0)
+        return;
+
+    uint32_t cx, cy;
+
+    // cells around players stay active
+    for (cx = 0; cx < m_cells.size(); cx++)
+    {
+        for (cy = 0; cy < m_cells[cx].size(); cy++)
+        {
+            for (WorldObject* obj : m_cells[cx][cy].objects)
+            {
+                if (obj->GetType() == OTYPE_PLAYER)
+                {
+                    ActivateCellsAround(cx, cy);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (cx = 0; cx < m_cells.size(); cx++)
+    {
+        for (cy = 0; cy < m_cells[cx].size(); cy++)
+        {
+            if (m_cells[cx][cy].spawned && IsCellIdle(cx, cy))
+                DespawnCell(cx, cy);
+        }
+    }
+
+    ProcessPendingCellRemovals();
+}
+
+void Map::UnloadContents()
+{
+    // posted commands may still refer to objects in map
+    ProcessCommands();
+
+    // objects pending removal are present in more cells, get rid of duplicates
+    ProcessPendingCellRemovals();
+
+    for (MapCellRow& row : m_cells)
+    {
+        for (MapCell& cell : row)
+        {
+            for (WorldObject* obj : cell.objects)
+            {
+                // players are owned by their sessions
+                if (obj->GetType() == OTYPE_PLAYER)
+                {
+                    sLog->Error("Player %s is still present on map %u (instance %u) being unloaded", obj->GetName(), m_mapId, m_instanceId);
+                    obj->SetMapCellSlot(MAP_CELL_SLOT_NONE);
+                    obj->SetMap(nullptr);
+                    continue;
+                }
+
+                // instance spawns have their GUIDs allocated, base map uses spawn GUIDs
+                sObjectAccessor->RetireObject(obj, IsInstance());
+            }
+        }
+    }
+
+    // the pathfinding layer is reset back to shared pages, chunks may be unloaded now
+    m_cells.clear();
+    if (m_storedMapRecord)
+        m_pathfindLayer.Init(m_storedMapRecord);
+    ReleaseChunks();
+
+    m_playerCount = 0;
+    m_emptySince = getMSTime();
+}
+
 void Map::AddToMap(WorldObject* obj)
 {
     uint32_t cx, cy;
@@ -107,18 +322,20 @@ void Map::AddToMap(WorldObject* obj)
     cx = GetCellIndexX(obj->GetPositionX());
     cy = GetCellIndexY(obj->GetPositionY());
 
-    // add object to cell
-    m_objects[cx][cy].push_back(obj);
+    obj->SetMap(this);
 
-    // create object in cell
-    SmartPacket pkt(SP_CREATE_OBJECT);
-    pkt.WriteUInt8(1); // will create 1 object
-    obj->BuildCreatePacketBlock(pkt);
-    SendPacketToSorroundings(cx, cy, pkt);
+    // add object to cell
+    InsertToCell(cx, cy, obj, obj->GetPositionX(), obj->GetPositionY());
 
-    // if it's player, create sorroundings for him
+    // player makes cells around him spawn their contents
     if (obj->GetType() == OTYPE_PLAYER)
-        SendCreateSorroundings(obj->ToPlayer());
+    {
+        m_playerCount++;
+        ActivateCellsAround(cx, cy);
+    }
+
+    // create object for players who see it, and create sorroundings for him if it's player
+    UpdateVisibilityOf(obj);
 
     // if it's gameobject, put it into pathfinding map also
     if (obj->GetType() == OTYPE_GAMEOBJECT)
@@ -137,26 +354,46 @@ void Map::RemoveFromMap(WorldObject* obj)
     if (obj->GetType() == OTYPE_GAMEOBJECT)
         DisablePathfindCollision(obj);
 
-    // lock scope
-    {
-        std::unique_lock<std::recursive_mutex> lck(m_mapUpdateMutex);
+    // erase him from cell
+    EraseFromCell(cx, cy, obj);
 
-        // find him in cell and erase him
-        for (WorldObjectList::iterator itr = m_objects[cx][cy].begin(); itr != m_objects[cx][cy].end(); ++itr)
+    // erase him also from cells he left, but wasn't removed from yet
+    for (std::list<PendingCellRemoval>::iterator itr = m_pendingCellRemovals.begin(); itr != m_pendingCellRemovals.end(); )
+    {
+        if (itr->object == obj)
         {
-            if ((*itr)->GetGUID() == obj->GetGUID())
-            {
-                m_objects[cx][cy].erase(itr);
-                break;
-            }
+            EraseFromCell(itr->cellX, itr->cellY, obj);
+            itr = m_pendingCellRemovals.erase(itr);
         }
+        else
+            ++itr;
     }
 
-    // destroy object for objects in his cell
-    SmartPacket pkt(SP_DESTROY_OBJECT);
-    pkt.WriteUInt8(1); // will destroy 1 object
-    pkt.WriteUInt64(obj->GetGUID());
-    SendPacketToSorroundings(cx, cy, pkt);
+    // player stops watching his sorroundings (including himself)
+    if (obj->GetType() == OTYPE_PLAYER)
+    {
+        obj->ToPlayer()->ClearVisibleObjects();
+
+        // the map starts to be idle
+        if (m_playerCount > 0 && --m_playerCount == 0)
+            m_emptySince = getMSTime();
+    }
+
+    // destroy object for its watchers; captured to snapshot, so it's not sent before changes captured earlier
+    if (!obj->GetWatchers().empty())
+    {
+        SmartPacket pkt(SP_DESTROY_OBJECT);
+        pkt.WriteUInt8(1); // will destroy 1 object
+        pkt.WriteUInt64(obj->GetGUID());
+
+        GetSnapshot().AddPacket(pkt);
+        for (Player* plr : obj->GetWatchers())
+            GetSnapshot().AddRecipient(plr->GetSession());
+    }
+
+    obj->ClearWatchers();
+
+    obj->SetMap(nullptr);
 }
 
 void Map::Relocate(WorldObject* obj, float oldX, float oldY, float newX, float newY)
@@ -168,229 +405,394 @@ void Map::Relocate(WorldObject* obj, float oldX, float oldY, float newX, float n
     cellX_new = GetCellIndexX(newX);
     cellY_new = GetCellIndexY(newY);
 
-    // no need for cell relocation
+    uint32_t slot;
+
+    // no need for cell relocation, just update stored position
     if (cellX_old == cellX_new && cellY_old == cellY_new)
-        return;
+    {
+        slot = FindCellSlot(cellX_old, cellY_old, obj);
+        if (slot != MAP_CELL_SLOT_NONE)
+        {
+            m_cells[cellX_old][cellY_old].positionsX[slot] = newX;
+            m_cells[cellX_old][cellY_old].positionsY[slot] = newY;
+        }
 
-    uint32_t itX, itY;
+        // update visibility after travelling some distance since the last update
+        if (obj->GetPosition().GetDistance(obj->GetVisibilityUpdatePosition()) >= MAP_VISIBILITY_UPDATE_DISTANCE)
+            UpdateVisibilityOf(obj);
 
-    // old sorrounding limits
-    uint32_t beginX, endX, beginY, endY;
-    GetCellSorroundingLimits(cellX_old, cellY_old, beginX, beginY, endX, endY);
+        return;
+    }
 
-    // new sorrounding limits
-    uint32_t beginX_n, endX_n, beginY_n, endY_n;
-    GetCellSorroundingLimits(cellX_new, cellY_new, beginX_n, beginY_n, endX_n, endY_n);
+    // the record in old cell stays there until the removal is processed, make sure it won't appear in range queries
+    slot = FindCellSlot(cellX_old, cellY_old, obj);
+    if (slot != MAP_CELL_SLOT_NONE)
+    {
+        m_cells[cellX_old][cellY_old].positionsX[slot] = MAP_CELL_STALE_POSITION;
+        m_cells[cellX_old][cellY_old].positionsY[slot] = MAP_CELL_STALE_POSITION;
+    }
 
-    for (itX = beginX; itX <= endX; itX++)
+    m_pendingCellRemovals.push_back(PendingCellRemoval(cellX_old, cellY_old, obj));
+
+    // the object may return to cell it left before the removal was processed; just cancel the removal then
+    bool returning = false;
+    for (std::list<PendingCellRemoval>::iterator itr = m_pendingCellRemovals.begin(); itr != m_pendingCellRemovals.end(); ++itr)
     {
-        for (itY = beginY; itY <= endY; itY++)
+        if (itr->object == obj && itr->cellX == cellX_new && itr->cellY == cellY_new)
         {
-            // these coordinates are in the new cell sorroundings, no need to update
-            if (itX >= beginX_n && itX <= endX_n && itY >= beginY_n && itY <= endY_n)
-                continue;
-
-            // leaving sorrounding, destroy player in that cell and destroy objects for them
-            SendCellDeletePacketsFor(itX, itY, obj);
+            m_pendingCellRemovals.erase(itr);
+            returning = true;
+            break;
         }
     }
 
-    // lock scope
+    slot = returning ? FindCellSlot(cellX_new, cellY_new, obj) : MAP_CELL_SLOT_NONE;
+    if (slot != MAP_CELL_SLOT_NONE)
     {
-        std::unique_lock<std::recursive_mutex> lck(m_mapUpdateMutex);
+        m_cells[cellX_new][cellY_new].positionsX[slot] = newX;
+        m_cells[cellX_new][cellY_new].positionsY[slot] = newY;
+        obj->SetMapCellSlot(slot);
+    }
+    else
+        InsertToCell(cellX_new, cellY_new, obj, newX, newY);
 
-        m_pendingCellRemovals.push_back(PendingCellRemoval(cellX_old, cellY_old, obj));
+    // player entered new cell, spawn contents of cells, that became near
+    if (obj->GetType() == OTYPE_PLAYER)
+        ActivateCellsAround(cellX_new, cellY_new);
 
-        m_objects[cellX_new][cellY_new].push_back(obj);
-    }
+    // create and destroy objects entering and leaving visibility
+    UpdateVisibilityOf(obj);
+}
 
-    for (itX = beginX_n; itX <= endX_n; itX++)
-    {
-        for (itY = beginY_n; itY <= endY_n; itY++)
-        {
-            // these coordinates are in the old cell sorroundings, no need to update
-            if (itX >= beginX && itX <= endX && itY >= beginY && itY <= endY)
-                continue;
+void Map::EnablePathfindCollision(WorldObject* obj)
+{
+    uint32_t startX, startY, endX, endY;
 
-            // entering new sorrounding, create player in that cell and send him objects here
-            SendCellCreatePacketsFor(itX, itY, obj);
-        }
+    if (GetPathfindCollisionBox(obj, startX, startY, endX, endY))
+    {
+        LoadChunksInBox(startX, startY, endX, endY);
+        m_pathfindLayer.AddObstacle(startX, startY, endX, endY);
     }
 }
 
-void Map::EnablePathfindCollision(WorldObject* obj)
+void Map::DisablePathfindCollision(WorldObject* obj)
+{
+    uint32_t startX, startY, endX, endY;
+
+    // the box has to be the same as when enabling collision, so the obstacle counts match
+    if (GetPathfindCollisionBox(obj, startX, startY, endX, endY))
+        m_pathfindLayer.RemoveObstacle(startX, startY, endX, endY);
+}
+
+bool Map::GetPathfindCollisionBox(WorldObject* obj, uint32_t &startX, uint32_t &startY, uint32_t &endX, uint32_t &endY)
 {
     float sizeX = obj->GetBoxUnitSizeX();
     float sizeY = obj->GetBoxUnitSizeY();
 
-    float startX = obj->GetPositionX() - sizeX / 2.0f;
-    float endX = startX + sizeX;
-    float startY = obj->GetPositionY() - sizeY / 2.0f;
-    float endY = startY + sizeY;
+    float fStartX = obj->GetPositionX() - sizeX / 2.0f;
+    float fEndX = fStartX + sizeX;
+    float fStartY = obj->GetPositionY() - sizeY / 2.0f;
+    float fEndY = fStartY + sizeY;
 
-    for (uint32_t i = (uint32_t)startX; i <= (uint32_t)endX; i++)
-    {
-        for (uint32_t j = (uint32_t)startY; j <= (uint32_t)endY; j++)
-        {
-            PathfindField* fld = GetPathfindField(i, j);
-            if (!fld)
-                continue;
+    // box lies completely outside the map
+    if (fEndX < 0.0f || fEndY < 0.0f)
+        return false;
 
-            fld->m_obstacleGUIDs.insert(obj->GetGUID());
-            // turn off all movement here, leave just "NONE" flag if present
-            fld->moveType &= (1 << MOVEMENT_TYPE_NONE);
+    startX = (fStartX < 0.0f) ? 0 : (uint32_t)fStartX;
+    startY = (fStartY < 0.0f) ? 0 : (uint32_t)fStartY;
+    endX = (uint32_t)fEndX;
+    endY = (uint32_t)fEndY;
 
-            sLog->Info("Marking field %u : %u as non-walkable (%u)", i, j, fld->moveType);
-        }
-    }
+    return true;
 }
 
-void Map::DisablePathfindCollision(WorldObject* obj)
+float Map::GetVisibilityDistance(float x, float y)
 {
-    float sizeX = obj->GetBoxUnitSizeX();
-    float sizeY = obj->GetBoxUnitSizeY();
+    uint32_t cellX = GetCellIndexX(x);
+    uint32_t cellY = GetCellIndexY(y);
 
-    float startX = obj->GetPositionX() + obj->GetBoxUnitCenterX() - sizeX / 2;
-    float endX = startX + sizeX;
-    float startY = obj->GetPositionY() + obj->GetBoxUnitCenterY() - sizeY / 2;
-    float endY = startY + sizeY;
+    // subdivision level of node containing given position
+    uint8_t level = 0;
+    if (cellX < m_cells.size() && cellY < m_cells[cellX].size())
+        level = m_cells[cellX][cellY].visibilityLevels[((uint32_t)x - GetCellStartX(cellX)) / MAP_VISIBILITY_NODE_MIN_SIZE_X][((uint32_t)y - GetCellStartY(cellY)) / MAP_VISIBILITY_NODE_MIN_SIZE_Y];
 
-    for (uint32_t i = (uint32_t)startX; i < (uint32_t)endX; i++)
-    {
-        for (uint32_t j = (uint32_t)startY; j < (uint32_t)endY; j++)
-        {
-            PathfindField* fld = GetPathfindField(i, j);
-            if (!fld)
-                continue;
+    // within subdivided cell, the distance is limited by node sorroundings; for non-subdivided cell, this equals to cell sorroundings
+    return num_min(m_visibilityDistance, (float)(MAP_SORROUNDING_CELLS_X * (MAP_CELL_SIZE_X >> level)));
+}
 
-            fld->m_obstacleGUIDs.erase(obj->GetGUID());
-            // if we are removing last obstacle, and the field was not marked solid before, restore original move mask
-            if (fld->m_obstacleGUIDs.size() == 0 && (fld->moveType & (1 << MOVEMENT_TYPE_NONE)) != 0)
-                fld->moveType = GetMovementTypeMaskFor(GetFieldAbs(i, j));
-        }
-    }
+bool Map::IsVisibleFor(Player* plr, WorldObject* obj)
+{
+    float dist = GetVisibilityDistance(plr->GetPositionX(), plr->GetPositionY());
+
+    // objects already visible are kept a bit further, so they are not created and destroyed repeatedly at visibility border
+    if (obj->IsWatchedBy(plr))
+        dist += MAP_VISIBILITY_HYSTERESIS;
+
+    float dx = obj->GetPositionX() - plr->GetPositionX();
+    float dy = obj->GetPositionY() - plr->GetPositionY();
+
+    return (dx*dx + dy*dy <= dist*dist);
 }
 
-uint32_t Map::GetMovementTypeMaskFor(MapField* fld)
+void Map::UpdateVisibilityOf(WorldObject* obj)
 {
-    uint32_t typeMask = 0;
+    obj->SetVisibilityUpdatePosition(obj->GetPosition());
 
-    if (fld->type == MFT_SOLID)
-        typeMask |= 1 << MOVEMENT_TYPE_NONE;
-    else
+    // update what the player sees
+    if (obj->GetType() == OTYPE_PLAYER)
+        UpdateVisibilityForViewer(obj->ToPlayer());
+
+    // update who sees the object
+    UpdateWatchersOf(obj);
+}
+
+void Map::UpdateVisibilityForViewer(Player* plr)
+{
+    WorldObjectVector inRange, entering, leaving;
+    GetObjectsInRange(plr->GetPositionX(), plr->GetPositionY(), GetVisibilityDistance(plr->GetPositionX(), plr->GetPositionY()), inRange);
+
+    // objects the player does not see yet
+    for (WorldObject* obj : inRange)
     {
-        if (fld->type == MFT_GROUND)
-            typeMask |= 1 << MOVEMENT_TYPE_WALK;
-        if (fld->type == MFT_WATER || fld->type == MFT_LAVA)
-            typeMask |= 1 << MOVEMENT_TYPE_SWIM;
+        if (!obj->IsWatchedBy(plr))
+            entering.push_back(obj);
     }
 
-    return typeMask;
+    // objects, that are no longer visible
+    for (WorldObject* obj : plr->GetVisibleObjects())
+    {
+        if (!IsVisibleFor(plr, obj))
+            leaving.push_back(obj);
+    }
+
+    for (WorldObject* obj : entering)
+        obj->AddWatcher(plr);
+    for (WorldObject* obj : leaving)
+        obj->RemoveWatcher(plr);
+
+    SendCreatePacketsTo(plr, entering);
+    SendDestroyPacketsTo(plr, leaving);
 }
 
-void Map::SendCellCreatePacketsFor(uint32_t cellX, uint32_t cellY, WorldObject* wobj)
+void Map::UpdateWatchersOf(WorldObject* obj)
 {
-    // create player in that cell
-    SmartPacket cpkt(SP_CREATE_OBJECT);
-    cpkt.WriteUInt8(1); // will create 1 object
-    wobj->BuildCreatePacketBlock(cpkt);
-    SendPacketToCell(cellX, cellY, cpkt);
+    // drop watchers, who no longer see the object; create and destroy packets are captured to snapshot
+    // to keep their order with captured object changes
+    WatcherSet watchers = obj->GetWatchers();
+    if (!watchers.empty())
+    {
+        SmartPacket pkt(SP_DESTROY_OBJECT);
+        pkt.WriteUInt8(1); // will destroy 1 object
+        pkt.WriteUInt64(obj->GetGUID());
 
-    // for non-players, we are done
-    if (wobj->GetType() != OTYPE_PLAYER)
-        return;
+        bool captured = false;
+
+        for (Player* plr : watchers)
+        {
+            if (IsVisibleFor(plr, obj))
+                continue;
+
+            if (!captured)
+            {
+                GetSnapshot().AddPacket(pkt);
+                captured = true;
+            }
 
-    Player* plr = wobj->ToPlayer();
+            obj->RemoveWatcher(plr);
+            GetSnapshot().AddRecipient(plr->GetSession());
+        }
+    }
+
+    // any player, who could see the object, is within map visibility distance
+    WorldObjectVector players;
+    GetObjectsInRange(obj->GetPositionX(), obj->GetPositionY(), m_visibilityDistance, players, MapQueryFilter(OTYPE_MASK(OTYPE_PLAYER)));
 
-    // send objects in that cell for player
     SmartPacket* pkt = nullptr;
-    uint32_t counter = UPDATEPACKET_COUNT_LIMIT;
+    Player* plr;
 
-    for (WorldObject *obj : m_objects[cellX][cellY])
+    for (WorldObject* wobj : players)
     {
-        if (counter >= UPDATEPACKET_COUNT_LIMIT)
+        plr = wobj->ToPlayer();
+        if (obj->IsWatchedBy(plr) || !IsVisibleFor(plr, obj))
+            continue;
+
+        // build create packet only once, and only when needed
+        if (!pkt)
         {
-            if (pkt)
-            {
-                pkt->WriteUInt8At(counter, 0);
-                plr->SendPacketToMe(*pkt);
-            }
-            else
-            {
-                pkt = new SmartPacket(SP_CREATE_OBJECT);
-                pkt->WriteUInt8(0); // placeholder
-            }
+            pkt = new SmartPacket(SP_CREATE_OBJECT);
+            pkt->WriteUInt8(1); // will create 1 object
+            obj->BuildCreatePacketBlock(*pkt);
 
-            pkt->ResetData();
-            counter = 0;
+            GetSnapshot().AddPacket(*pkt);
         }
 
-        obj->BuildCreatePacketBlock(*pkt);
-        counter++;
+        obj->AddWatcher(plr);
+        GetSnapshot().AddRecipient(plr->GetSession());
     }
 
     if (pkt)
+        delete pkt;
+}
+
+void Map::CapturePacketTo(Player* plr, SmartPacket &pkt)
+{
+    GetSnapshot().AddPacket(pkt);
+    GetSnapshot().AddRecipient(plr->GetSession());
+}
+
+void Map::SendCreatePacketsTo(Player* plr, WorldObjectVector const& objects)
+{
+    if (objects.empty())
+        return;
+
+    SmartPacket pkt(SP_CREATE_OBJECT);
+    pkt.WriteUInt8(0); // placeholder
+    uint32_t counter = 0;
+
+    for (WorldObject *obj : objects)
     {
-        if (counter > 0)
+        // split to multiple packets if needed (if the count or size exceeds limit)
+        if (counter >= UPDATEPACKET_COUNT_LIMIT || pkt.GetSize() >= UPDATEPACKET_SIZE_LIMIT)
         {
-            pkt->WriteUInt8At(counter, 0);
-            plr->SendPacketToMe(*pkt);
+            pkt.WriteUInt8At(counter, 0);
+            CapturePacketTo(plr, pkt);
+
+            pkt.ResetData();
+            pkt.WriteUInt8(0); // placeholder
+            counter = 0;
         }
 
-        delete pkt;
+        obj->BuildCreatePacketBlock(pkt);
+        counter++;
     }
+
+    pkt.WriteUInt8At(counter, 0);
+    CapturePacketTo(plr, pkt);
 }
 
-void Map::SendCellDeletePacketsFor(uint32_t cellX, uint32_t cellY, WorldObject* wobj)
+void Map::SendDestroyPacketsTo(Player* plr, WorldObjectVector const& objects)
 {
-    // destroy player in that cell
-    SmartPacket cpkt(SP_DESTROY_OBJECT);
-    cpkt.WriteUInt8(1); // will create 1 object
-    cpkt.WriteUInt64(wobj->GetGUID());
-    SendPacketToCell(cellX, cellY, cpkt);
-
-    // for non-players, we are done
-    if (wobj->GetType() != OTYPE_PLAYER)
+    if (objects.empty())
         return;
 
-    Player* plr = wobj->ToPlayer();
+    SmartPacket pkt(SP_DESTROY_OBJECT);
+    pkt.WriteUInt8(0); // placeholder
+    uint32_t counter = 0;
 
-    // destroy objects in that cell for player
-    SmartPacket* pkt = nullptr;
-    uint32_t counter = UPDATEPACKET_COUNT_LIMIT;
+    for (WorldObject *obj : objects)
+    {
+        // split to multiple packets if needed (if the count or size exceeds limit)
+        if (counter >= UPDATEPACKET_COUNT_LIMIT || pkt.GetSize() >= UPDATEPACKET_SIZE_LIMIT)
+        {
+            pkt.WriteUInt8At(counter, 0);
+            CapturePacketTo(plr, pkt);
+
+            pkt.ResetData();
+            pkt.WriteUInt8(0); // placeholder
+            counter = 0;
+        }
 
-    for (WorldObject *obj : m_objects[cellX][cellY])
+        pkt.WriteUInt64(obj->GetGUID());
+        counter++;
+    }
+
+    pkt.WriteUInt8At(counter, 0);
+    CapturePacketTo(plr, pkt);
+}
+
+void Map::RebuildVisibilitySubdivision()
+{
+    uint32_t cx, cy, i, gx, gy;
+    bool changed, subdivided;
+    std::vector<uint32_t> indices;
+
+    for (cx = 0; cx < m_cells.size(); cx++)
     {
-        if (counter >= UPDATEPACKET_COUNT_LIMIT)
+        for (cy = 0; cy < m_cells[cx].size(); cy++)
         {
-            if (pkt)
+            MapCell& cell = m_cells[cx][cy];
+
+            // sparse cells, that are not subdivided, stay as they are
+            if (!cell.subdivided && cell.objects.size() <= MAP_VISIBILITY_SPLIT_THRESHOLD)
+                continue;
+
+            // stale records (pending removal) carry negative position
+            indices.clear();
+            for (i = 0; i < cell.objects.size(); i++)
             {
-                pkt->WriteUInt8At(counter, 0);
-                plr->SendPacketToMe(*pkt);
+                if (cell.positionsX[i] >= 0.0f)
+                    indices.push_back(i);
             }
-            else
+
+            changed = false;
+            SubdivideVisibilityNode(cell, GetCellStartX(cx), GetCellStartY(cy), 0, 0, 0, indices, changed);
+
+            if (!changed)
+                continue;
+
+            subdivided = false;
+            for (gx = 0; gx < MAP_VISIBILITY_GRID_SIZE && !subdivided; gx++)
             {
-                pkt = new SmartPacket(SP_DESTROY_OBJECT);
-                pkt->WriteUInt8(0); // placeholder
+                for (gy = 0; gy < MAP_VISIBILITY_GRID_SIZE && !subdivided; gy++)
+                    subdivided = (cell.visibilityLevels[gx][gy] != 0);
             }
 
-            pkt->ResetData();
-            counter = 0;
+            cell.subdivided = subdivided;
+
+            // visibility distance of players in this cell changed
+            for (uint32_t index : indices)
+            {
+                if (cell.objects[index]->GetType() == OTYPE_PLAYER)
+                    UpdateVisibilityForViewer(cell.objects[index]->ToPlayer());
+            }
         }
+    }
+}
 
-        pkt->WriteUInt64(obj->GetGUID());
-        counter++;
+void Map::SubdivideVisibilityNode(MapCell &cell, uint32_t cellStartX, uint32_t cellStartY, uint8_t level, uint32_t nodeX, uint32_t nodeY, std::vector<uint32_t> const& indices, bool &changed)
+{
+    // node span in smallest node units
+    uint32_t span = MAP_VISIBILITY_GRID_SIZE >> level;
+    uint32_t gx, gy, i;
+
+    bool wasSplit = false;
+    for (gx = nodeX * span; gx < (nodeX + 1) * span && !wasSplit; gx++)
+    {
+        for (gy = nodeY * span; gy < (nodeY + 1) * span && !wasSplit; gy++)
+            wasSplit = (cell.visibilityLevels[gx][gy] > level);
     }
 
-    if (pkt)
+    // split dense node; use lower threshold for already split nodes to avoid flapping
+    if (level < MAP_VISIBILITY_MAX_LEVEL && (indices.size() > MAP_VISIBILITY_SPLIT_THRESHOLD || (wasSplit && indices.size() > MAP_VISIBILITY_MERGE_THRESHOLD)))
     {
-        if (counter > 0)
+        std::vector<uint32_t> quadrants[4];
+
+        // half of node size in fields
+        float halfX = (float)((MAP_CELL_SIZE_X >> level) / 2);
+        float halfY = (float)((MAP_CELL_SIZE_Y >> level) / 2);
+        float midX = (float)(cellStartX + nodeX * (MAP_CELL_SIZE_X >> level)) + halfX;
+        float midY = (float)(cellStartY + nodeY * (MAP_CELL_SIZE_Y >> level)) + halfY;
+
+        for (uint32_t index : indices)
+            quadrants[(cell.positionsX[index] >= midX ? 1 : 0) | (cell.positionsY[index] >= midY ? 2 : 0)].push_back(index);
+
+        for (i = 0; i < 4; i++)
+            SubdivideVisibilityNode(cell, cellStartX, cellStartY, level + 1, nodeX * 2 + (i & 1), nodeY * 2 + (i >> 1), quadrants[i], changed);
+
+        return;
+    }
+
+    // leaf node (merge subnodes, if any)
+    for (gx = nodeX * span; gx < (nodeX + 1) * span; gx++)
+    {
+        for (gy = nodeY * span; gy < (nodeY + 1) * span; gy++)
         {
-            pkt->WriteUInt8At(counter, 0);
-            plr->SendPacketToMe(*pkt);
+            if (cell.visibilityLevels[gx][gy] != level)
+            {
+                cell.visibilityLevels[gx][gy] = level;
+                changed = true;
+            }
         }
-
-        delete pkt;
     }
 }
 
@@ -399,6 +801,21 @@ uint32_t Map::GetMapID()
     return m_mapId;
 }
 
+uint32_t Map::GetInstanceID()
+{
+    return m_instanceId;
+}
+
+bool Map::IsInstance()
+{
+    return m_instanceId != MAP_BASE_INSTANCE_ID;
+}
+
+bool Map::IsIdle(uint32_t idleTime)
+{
+    return m_playerCount == 0 && getMSTimeDiff(m_emptySince, getMSTime()) >= idleTime;
+}
+
 uint32_t Map::GetCellIndexX(float fieldX)
 {
     return (uint32_t)fieldX / MAP_CELL_SIZE_X;
@@ -421,186 +838,458 @@ uint32_t Map::GetCellStartY(uint32_t indexY)
 
 MapField* Map::GetField(float x, float y)
 {
-    uint32_t iX = GetCellIndexX(x);
-    uint32_t iY = GetCellIndexY(y);
-
-    if (m_storedMapRecord->chunks.size() <= iX)
+    if (x < 0.0f || y < 0.0f)
         return nullptr;
-    if (m_storedMapRecord->chunks[iX].size() <= iY)
+
+    return GetFieldAbs((uint32_t)x, (uint32_t)y);
+}
+
+MapField* Map::GetFieldAbs(uint32_t x, uint32_t y)
+{
+    if (!GetChunk(MapStorage::GetChunkIndexX(x), MapStorage::GetChunkIndexY(y)))
         return nullptr;
 
-    MapChunkRecord* target = &m_storedMapRecord->chunks[iX][iY];
+    return m_storedMapRecord->GetField(x, y);
+}
 
-    iX = target->GetFieldOffsetX((uint32_t)x);
-    iY = target->GetFieldOffsetY((uint32_t)y);
+bool Map::IsPathfindAccessible(uint32_t x, uint32_t y, uint32_t moveMask)
+{
+    if (!GetChunk(MapStorage::GetChunkIndexX(x), MapStorage::GetChunkIndexY(y)))
+        return false;
 
-    return &target->fields[iX][iY];
+    return m_pathfindLayer.IsAccessible(x, y, moveMask);
 }
 
-MapField* Map::GetFieldAbs(uint32_t x, uint32_t y)
+bool Map::CanMoveOn(float x, float y, uint32_t moveMask)
 {
-    uint32_t iX = x / MAP_CELL_SIZE_X;
-    uint32_t iY = y / MAP_CELL_SIZE_Y;
+    if (x < 0.0f || y < 0.0f || !m_storedMapRecord)
+        return false;
 
-    if (m_storedMapRecord->chunks.size() <= iX)
-        return nullptr;
-    if (m_storedMapRecord->chunks[iX].size() <= iY)
-        return nullptr;
+    uint32_t ix = (uint32_t)x;
+    uint32_t iy = (uint32_t)y;
 
-    MapChunkRecord* target = &m_storedMapRecord->chunks[iX][iY];
+    if (ix >= m_storedMapRecord->header.sizeX || iy >= m_storedMapRecord->header.sizeY)
+        return false;
 
-    iX = target->GetFieldOffsetX(x);
-    iY = target->GetFieldOffsetY(y);
+    // base page of chunk contains walkability bitmaps built from map fields
+    MapChunkRecord* chunk = GetChunk(MapStorage::GetChunkIndexX(ix), MapStorage::GetChunkIndexY(iy));
+    if (!chunk || !chunk->pathfindPage)
+        return false;
 
-    return &target->fields[iX][iY];
+    return PathfindLayer::IsAccessibleOnPage(chunk->pathfindPage, ix, iy, moveMask);
 }
 
-PathfindField* Map::GetPathfindField(uint32_t x, uint32_t y)
+MapChunkRecord* Map::GetChunk(uint32_t chunkX, uint32_t chunkY)
 {
-    if (m_pathfindLayer.size() <= x)
+    if (!m_storedMapRecord || chunkX >= m_storedMapRecord->chunkCountX || chunkY >= m_storedMapRecord->chunkCountY)
         return nullptr;
-    if (m_pathfindLayer[x].size() <= y)
+
+    uint32_t index = chunkX * m_storedMapRecord->chunkCountY + chunkY;
+    if (index >= m_referencedChunks.size())
         return nullptr;
 
-    return &m_pathfindLayer[x][y];
+    // already referenced, so it's loaded
+    if (m_referencedChunks[index])
+        return &m_storedMapRecord->chunks[index];
+
+    MapChunkRecord* mch = sMapStorage->AcquireChunk(m_storedMapRecord, chunkX, chunkY);
+    if (mch)
+        m_referencedChunks[index] = true;
+
+    return mch;
 }
 
-void Map::GetCellSorroundingLimits(uint32_t cellX, uint32_t cellY, uint32_t &beginX, uint32_t &beginY, uint32_t &endX, uint32_t &endY)
+void Map::LoadChunksInBox(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2)
 {
-    beginX = cellX > MAP_SORROUNDING_CELLS_X ? cellX - MAP_SORROUNDING_CELLS_X : 0;
-    beginY = cellY > MAP_SORROUNDING_CELLS_Y ? cellY - MAP_SORROUNDING_CELLS_Y : 0;
+    if (!m_storedMapRecord || m_storedMapRecord->header.sizeX == 0 || m_storedMapRecord->header.sizeY == 0)
+        return;
 
-    endX = cellX < (uint32_t)m_objects.size() - 1 - MAP_SORROUNDING_CELLS_X ? cellX + MAP_SORROUNDING_CELLS_X : (uint32_t)m_objects.size() - 1;
-    endY = cellY < (uint32_t)m_objects[0].size() - 1 - MAP_SORROUNDING_CELLS_Y ? cellY + MAP_SORROUNDING_CELLS_Y : (uint32_t)m_objects[0].size() - 1;
+    uint32_t endX = MapStorage::GetChunkIndexX(num_min(x2, m_storedMapRecord->header.sizeX - 1));
+    uint32_t endY = MapStorage::GetChunkIndexY(num_min(y2, m_storedMapRecord->header.sizeY - 1));
+
+    for (uint32_t cx = MapStorage::GetChunkIndexX(x1); cx <= endX; cx++)
+        for (uint32_t cy = MapStorage::GetChunkIndexY(y1); cy <= endY; cy++)
+            GetChunk(cx, cy);
 }
 
-void Map::SendPacketToCell(uint32_t cellX, uint32_t cellY, SmartPacket &pkt)
+void Map::ReleaseChunks()
 {
-    for (WorldObject *obj : m_objects[cellX][cellY])
+    for (size_t i = 0; i < m_referencedChunks.size(); i++)
     {
-        // send only to players, nobody else would ever retrieve that packet
-        if (obj->GetType() == OTYPE_PLAYER)
-            obj->ToPlayer()->SendPacketToMe(pkt);
+        if (m_referencedChunks[i])
+            sMapStorage->ReleaseChunk(&m_storedMapRecord->chunks[i]);
     }
+
+    m_referencedChunks.clear();
 }
 
-void Map::SendPacketToSorroundings(uint32_t cellX, uint32_t cellY, SmartPacket &pkt)
+bool MapQueryFilter::Matches(WorldObject* obj) const
 {
-    uint32_t beginX, endX, beginY, endY, itY;
+    if (obj == exclude)
+        return false;
 
-    GetCellSorroundingLimits(cellX, cellY, beginX, beginY, endX, endY);
+    if ((typeMask & OTYPE_MASK(obj->GetType())) == 0)
+        return false;
 
-    for (; beginX <= endX; beginX++)
-        for (itY = beginY; itY <= endY; itY++)
-            SendPacketToCell(beginX, itY, pkt);
+    if (faction != MAP_QUERY_ANY_FACTION)
+    {
+        // only units have faction
+        if ((OTYPE_MASK(obj->GetType()) & OTYPE_MASK_UNIT) == 0)
+            return false;
+
+        if (((Unit*)obj)->GetFaction() != faction)
+            return false;
+    }
+
+    return true;
 }
 
-void Map::SendPacketToSorroundings(float x, float y, SmartPacket &pkt)
+// stores indexes of cell records within radius (squared) from point into output vector
+static void FilterCellByRadius(MapCell const& cell, float x, float y, float radiusSq, std::vector<uint32_t> &out)
 {
-    SendPacketToSorroundings(GetCellIndexX(x), GetCellIndexY(y), pkt);
+    const uint32_t count = (uint32_t)cell.objects.size();
+    const float* posX = cell.positionsX.data();
+    const float* posY = cell.positionsY.data();
+    float dx, dy;
+    uint32_t i = 0;
+
+#ifdef MAP_QUERY_USE_SSE2
+    const __m128 vx = _mm_set1_ps(x);
+    const __m128 vy = _mm_set1_ps(y);
+    const __m128 vr = _mm_set1_ps(radiusSq);
+    __m128 vdx, vdy;
+    int mask;
+
+    // process four records at once
+    for (; i + 4 <= count; i += 4)
+    {
+        vdx = _mm_sub_ps(_mm_loadu_ps(posX + i), vx);
+        vdy = _mm_sub_ps(_mm_loadu_ps(posY + i), vy);
+        mask = _mm_movemask_ps(_mm_cmple_ps(_mm_add_ps(_mm_mul_ps(vdx, vdx), _mm_mul_ps(vdy, vdy)), vr));
+
+        // most of the time, no record passes the check
+        if (mask == 0)
+            continue;
+
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            if ((mask & (1 << j)) != 0)
+                out.push_back(i + j);
+        }
+    }
+#endif
+
+    // process the rest
+    for (; i < count; i++)
+    {
+        dx = posX[i] - x;
+        dy = posY[i] - y;
+        if (dx*dx + dy*dy <= radiusSq)
+            out.push_back(i);
+    }
 }
 
-void Map::SendCreateSorroundings(Player* plr)
+// stores indexes of cell records within box into output vector
+static void FilterCellByBox(MapCell const& cell, float x1, float y1, float x2, float y2, std::vector<uint32_t> &out)
 {
-    uint32_t cellX = GetCellIndexX(plr->GetPositionX());
-    uint32_t cellY = GetCellIndexY(plr->GetPositionY());
-    uint32_t beginX, endX, beginY, endY, itY;
+    const uint32_t count = (uint32_t)cell.objects.size();
+    const float* posX = cell.positionsX.data();
+    const float* posY = cell.positionsY.data();
+    uint32_t i = 0;
+
+#ifdef MAP_QUERY_USE_SSE2
+    const __m128 vx1 = _mm_set1_ps(x1);
+    const __m128 vy1 = _mm_set1_ps(y1);
+    const __m128 vx2 = _mm_set1_ps(x2);
+    const __m128 vy2 = _mm_set1_ps(y2);
+    __m128 vpx, vpy;
+    int mask;
+
+    // process four records at once
+    for (; i + 4 <= count; i += 4)
+    {
+        vpx = _mm_loadu_ps(posX + i);
+        vpy = _mm_loadu_ps(posY + i);
+        mask = _mm_movemask_ps(_mm_and_ps(_mm_and_ps(_mm_cmpge_ps(vpx, vx1), _mm_cmple_ps(vpx, vx2)),
+                                          _mm_and_ps(_mm_cmpge_ps(vpy, vy1), _mm_cmple_ps(vpy, vy2))));
 
-    // retrieve sorroundings
-    GetCellSorroundingLimits(cellX, cellY, beginX, beginY, endX, endY);
+        if (mask == 0)
+            continue;
 
-    SmartPacket* pkt = nullptr;
-    uint32_t counter = UPDATEPACKET_COUNT_LIMIT;
+        for (uint32_t j = 0; j < 4; j++)
+        {
+            if ((mask & (1 << j)) != 0)
+                out.push_back(i + j);
+        }
+    }
+#endif
+
+    // process the rest
+    for (; i < count; i++)
+    {
+        if (posX[i] >= x1 && posX[i] <= x2 && posY[i] >= y1 && posY[i] <= y2)
+            out.push_back(i);
+    }
+}
+
+bool Map::GetCellRangeForBox(float x1, float y1, float x2, float y2, uint32_t &beginX, uint32_t &beginY, uint32_t &endX, uint32_t &endY)
+{
+    if (m_cells.empty() || x2 < 0.0f || y2 < 0.0f || x1 > x2 || y1 > y2)
+        return false;
+
+    beginX = (x1 < 0.0f) ? 0 : GetCellIndexX(x1);
+    beginY = (y1 < 0.0f) ? 0 : GetCellIndexY(y1);
+    endX = num_min(GetCellIndexX(x2), (uint32_t)m_cells.size() - 1);
+    endY = num_min(GetCellIndexY(y2), (uint32_t)m_cells[0].size() - 1);
+
+    return (beginX <= endX && beginY <= endY);
+}
+
+void Map::GetObjectsInRange(float x, float y, float radius, WorldObjectVector &result, MapQueryFilter const& filter)
+{
+    uint32_t beginX, beginY, endX, endY, itY;
+    if (!GetCellRangeForBox(x - radius, y - radius, x + radius, y + radius, beginX, beginY, endX, endY))
+        return;
+
+    std::vector<uint32_t> matches;
 
-    // create contents of each cell in sorroundings
     for (; beginX <= endX; beginX++)
     {
         for (itY = beginY; itY <= endY; itY++)
         {
-            for (WorldObject *obj : m_objects[beginX][itY])
-            {
-                // split to multiple packets if needed (if exceeds limit)
-                if (counter >= UPDATEPACKET_COUNT_LIMIT)
-                {
-                    if (pkt)
-                    {
-                        pkt->WriteUInt8At(counter, 0);
-                        plr->SendPacketToMe(*pkt);
-                        pkt->ResetData();
-                    }
-                    else
-                    {
-                        pkt = new SmartPacket(SP_CREATE_OBJECT);
-                        pkt->WriteUInt8(0); // placeholder
-                    }
-
-                    counter = 0;
-                }
+            MapCell& cell = m_cells[beginX][itY];
+
+            matches.clear();
+            FilterCellByRadius(cell, x, y, radius*radius, matches);
 
-                obj->BuildCreatePacketBlock(*pkt);
-                counter++;
+            for (uint32_t index : matches)
+            {
+                if (filter.Matches(cell.objects[index]))
+                    result.push_back(cell.objects[index]);
             }
         }
     }
+}
 
-    if (pkt)
+void Map::GetObjectsInBox(float x1, float y1, float x2, float y2, WorldObjectVector &result, MapQueryFilter const& filter)
+{
+    uint32_t beginX, beginY, endX, endY, itY;
+    if (!GetCellRangeForBox(x1, y1, x2, y2, beginX, beginY, endX, endY))
+        return;
+
+    std::vector<uint32_t> matches;
+
+    for (; beginX <= endX; beginX++)
     {
-        if (counter > 0)
+        for (itY = beginY; itY <= endY; itY++)
         {
-            pkt->WriteUInt8At(counter, 0);
-            plr->SendPacketToMe(*pkt);
-        }
+            MapCell& cell = m_cells[beginX][itY];
 
-        delete pkt;
+            matches.clear();
+            FilterCellByBox(cell, x1, y1, x2, y2, matches);
+
+            for (uint32_t index : matches)
+            {
+                if (filter.Matches(cell.objects[index]))
+                    result.push_back(cell.objects[index]);
+            }
+        }
     }
 }
 
-void Map::Update()
+WorldObject* Map::GetNearestObject(float x, float y, float radius, MapQueryFilter const& filter)
 {
-    std::unique_lock<std::recursive_mutex> lck(m_mapUpdateMutex);
+    uint32_t beginX, beginY, endX, endY, itY;
+    if (!GetCellRangeForBox(x - radius, y - radius, x + radius, y + radius, beginX, beginY, endX, endY))
+        return nullptr;
 
-    uint32_t cx, cy;
-    // TODO: manage and update only active cells
+    std::vector<uint32_t> matches;
+    WorldObject* nearest = nullptr;
+    float nearestDistSq = radius*radius;
+    float dx, dy;
 
-    if (!m_pendingCellRemovals.empty())
+    for (; beginX <= endX; beginX++)
     {
-        for (PendingCellRemoval& rem : m_pendingCellRemovals)
+        for (itY = beginY; itY <= endY; itY++)
         {
-            for (WorldObjectList::iterator itr = m_objects[rem.cellX][rem.cellY].begin(); itr != m_objects[rem.cellX][rem.cellY].end(); ++itr)
+            MapCell& cell = m_cells[beginX][itY];
+
+            matches.clear();
+            FilterCellByRadius(cell, x, y, nearestDistSq, matches);
+
+            for (uint32_t index : matches)
             {
-                if (*itr == rem.object)
+                dx = cell.positionsX[index] - x;
+                dy = cell.positionsY[index] - y;
+
+                if (dx*dx + dy*dy <= nearestDistSq && filter.Matches(cell.objects[index]))
                 {
-                    m_objects[rem.cellX][rem.cellY].erase(itr);
-                    break;
+                    nearest = cell.objects[index];
+                    nearestDistSq = dx*dx + dy*dy;
                 }
             }
         }
-        m_pendingCellRemovals.clear();
     }
 
-    for (cx = 0; cx < m_objects.size(); cx++)
+    return nearest;
+}
+
+void Map::GetCellSorroundingLimits(uint32_t cellX, uint32_t cellY, uint32_t &beginX, uint32_t &beginY, uint32_t &endX, uint32_t &endY)
+{
+    beginX = cellX > MAP_SORROUNDING_CELLS_X ? cellX - MAP_SORROUNDING_CELLS_X : 0;
+    beginY = cellY > MAP_SORROUNDING_CELLS_Y ? cellY - MAP_SORROUNDING_CELLS_Y : 0;
+
+    endX = cellX < (uint32_t)m_cells.size() - 1 - MAP_SORROUNDING_CELLS_X ? cellX + MAP_SORROUNDING_CELLS_X : (uint32_t)m_cells.size() - 1;
+    endY = cellY < (uint32_t)m_cells[0].size() - 1 - MAP_SORROUNDING_CELLS_Y ? cellY + MAP_SORROUNDING_CELLS_Y : (uint32_t)m_cells[0].size() - 1;
+}
+
+void Map::Update()
+{
+    uint32_t cx, cy, i;
+    // TODO: manage and update only active cells
+
+    // apply modifications requested from outside since the last update
+    ProcessCommands();
+
+    ProcessPendingCellRemovals();
+
+    // subdivide dense cells, merge the sparse ones
+    if (getMSTimeDiff(m_lastVisibilityRebuild, getMSTime()) >= MAP_VISIBILITY_REBUILD_INTERVAL)
+    {
+        RebuildVisibilitySubdivision();
+        m_lastVisibilityRebuild = getMSTime();
+    }
+
+    // despawn contents of cells, that were left by players long ago
+    if (getMSTimeDiff(m_lastCellDespawnCheck, getMSTime()) >= MAP_CELL_DESPAWN_CHECK_INTERVAL)
+    {
+        DespawnIdleCells();
+        m_lastCellDespawnCheck = getMSTime();
+    }
+
+    for (cx = 0; cx < m_cells.size(); cx++)
     {
-        for (cy = 0; cy < m_objects[cx].size(); cy++)
+        for (cy = 0; cy < m_cells[cx].size(); cy++)
         {
-            for (WorldObject* obj : m_objects[cx][cy])
-                obj->Update();
+            // iterate using index, objects may be inserted to cell during update
+            for (i = 0; i < m_cells[cx][cy].objects.size(); i++)
+                m_cells[cx][cy].objects[i]->Update();
 
             // remove pending objects (if any)
-            if (!m_pendingCellRemovals.empty())
-            {
-                for (PendingCellRemoval& rem : m_pendingCellRemovals)
-                {
-                    for (WorldObjectList::iterator itr = m_objects[rem.cellX][rem.cellY].begin(); itr != m_objects[rem.cellX][rem.cellY].end(); ++itr)
-                    {
-                        if (*itr == rem.object)
-                        {
-                            m_objects[rem.cellX][rem.cellY].erase(itr);
-                            break;
-                        }
-                    }
-                }
-                m_pendingCellRemovals.clear();
-            }
+            ProcessPendingCellRemovals();
         }
     }
 }
+
+void Map::PostCommand(MapCommand const& command)
+{
+    m_commandQueue.Push(command);
+}
+
+void Map::PostObjectCommand(uint64_t guid, MapObjectCommand const& command)
+{
+    PostCommand([this, guid, command]() {
+        WorldObject* obj = sObjectAccessor->FindWorldObject(guid);
+
+        // the object may have left the map in the meantime
+        if (obj && obj->GetMap() == this)
+            command(obj);
+    });
+}
+
+WorldSnapshot& Map::GetSnapshot()
+{
+    return m_snapshots[m_snapshotIndex];
+}
+
+WorldSnapshot* Map::PublishSnapshot()
+{
+    WorldSnapshot* finished = &m_snapshots[m_snapshotIndex];
+
+    // packets captured since now have to be sent after the finished snapshot
+    finished->CloseSendSlots();
+
+    m_snapshotIndex = 1 - m_snapshotIndex;
+    m_snapshots[m_snapshotIndex].Clear();
+
+    return finished;
+}
+
+void Map::ProcessCommands()
+{
+    MapCommand command;
+
+    // commands posted by executed commands are processed as well
+    while (m_commandQueue.Pop(command))
+        command();
+}
+
+void Map::InsertToCell(uint32_t cellX, uint32_t cellY, WorldObject* obj, float x, float y)
+{
+    MapCell& cell = m_cells[cellX][cellY];
+
+    obj->SetMapCellSlot((uint32_t)cell.objects.size());
+
+    cell.objects.push_back(obj);
+    cell.positionsX.push_back(x);
+    cell.positionsY.push_back(y);
+}
+
+void Map::EraseFromCell(uint32_t cellX, uint32_t cellY, WorldObject* obj)
+{
+    uint32_t slot = FindCellSlot(cellX, cellY, obj);
+    if (slot == MAP_CELL_SLOT_NONE)
+        return;
+
+    MapCell& cell = m_cells[cellX][cellY];
+    uint32_t last = (uint32_t)cell.objects.size() - 1;
+
+    // move last record to the place of erased one
+    if (slot != last)
+    {
+        WorldObject* moved = cell.objects[last];
+
+        cell.objects[slot] = moved;
+        cell.positionsX[slot] = cell.positionsX[last];
+        cell.positionsY[slot] = cell.positionsY[last];
+
+        // update stored slot only when this cell is the current cell of moved object; it may be just
+        // stale record pending removal, and its slot then belongs to another cell
+        if (GetCellIndexX(moved->GetPositionX()) == cellX && GetCellIndexY(moved->GetPositionY()) == cellY)
+            moved->SetMapCellSlot(slot);
+    }
+
+    cell.objects.pop_back();
+    cell.positionsX.pop_back();
+    cell.positionsY.pop_back();
+}
+
+uint32_t Map::FindCellSlot(uint32_t cellX, uint32_t cellY, WorldObject* obj)
+{
+    MapCell& cell = m_cells[cellX][cellY];
+
+    // stored slot is valid for the cell the object currently resides in
+    uint32_t slot = obj->GetMapCellSlot();
+    if (slot < cell.objects.size() && cell.objects[slot] == obj)
+        return slot;
+
+    // otherwise search for it
+    for (slot = 0; slot < cell.objects.size(); slot++)
+    {
+        if (cell.objects[slot] == obj)
+            return slot;
+    }
+
+    return MAP_CELL_SLOT_NONE;
+}
+
+void Map::ProcessPendingCellRemovals()
+{
+    if (m_pendingCellRemovals.empty())
+        return;
+
+    for (PendingCellRemoval& rem : m_pendingCellRemovals)
+        EraseFromCell(rem.cellX, rem.cellY, rem.object);
+
+    m_pendingCellRemovals.clear();
+}
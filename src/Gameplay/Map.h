@@ -21,30 +21,87 @@
 #define BW_MAP_H
 
 #include "MapEnums.h"
+#include "ObjectEnums.h"
+#include "PathfindLayer.h"
+#include "MapCommandQueue.h"
+#include "WorldSnapshot.h"
+#include "CreatureStorage.h"
+#include "GameobjectStorage.h"
+
+struct MapRecord;
+struct MapChunkRecord;
+struct MapField;
+class WorldObject;
+class SmartPacket;
+class Player;
+
+typedef std::vector<WorldObject*> WorldObjectVector;
+
+// command executed within map update on object present in map
+typedef std::function<void(WorldObject*)> MapObjectCommand;
 
 /*
- * Structure containing data used when searching for path
+ * Structure containing objects within one map cell; positions are stored separately
+ * (structure of arrays, same index as object) so distance filtering could be vectorized
  */
-struct PathfindField
+struct MapCell
 {
-    // movement type allowed here (see enum MovementType); if "NONE" flag is present, the field is marked solid by map definition, not by obstacle present
-    uint32_t moveType;
-    // GUIDs of dynamic obstacles
-    std::set<uint64_t> m_obstacleGUIDs;
+    MapCell() : subdivided(false), spawned(false), lastActiveTime(0) { memset(visibilityLevels, 0, sizeof(visibilityLevels)); };
+
+    // objects in cell
+    WorldObjectVector objects;
+    // X coordinates of objects
+    std::vector<float> positionsX;
+    // Y coordinates of objects
+    std::vector<float> positionsY;
+
+    // visibility subdivision level of every smallest visibility node within cell (0 = whole cell is one node)
+    uint8_t visibilityLevels[MAP_VISIBILITY_GRID_SIZE][MAP_VISIBILITY_GRID_SIZE];
+    // is the cell subdivided to more visibility nodes?
+    bool subdivided;
+
+    // creature spawns positioned within cell; instantiated when the cell gets near a player
+    std::vector<CreatureSpawnRecord> creatureSpawns;
+    // gameobject spawns positioned within cell
+    std::vector<GameobjectSpawnRecord> gameobjectSpawns;
+    // GUIDs of objects instantiated from cell spawns
+    std::vector<uint64_t> spawnedGuids;
+    // are the cell spawns instantiated?
+    bool spawned;
+    // time when the cell was near a player for the last time
+    uint32_t lastActiveTime;
 };
 
-typedef std::vector<PathfindField> PathfindFieldRow;
-typedef std::vector<PathfindFieldRow> PathfindMap;
+typedef std::vector<MapCell> MapCellRow;
+typedef std::vector<MapCellRow> MapCellGrid;
 
-struct MapRecord;
-struct MapField;
-class WorldObject;
-class SmartPacket;
-class Player;
+// makes object type mask from object type
+#define OTYPE_MASK(t) (1 << (t))
+// object type mask containing all object types
+#define OTYPE_MASK_ALL (OTYPE_MASK(MAX_OBJECT_TYPE) - 1)
+// object type mask containing all unit types
+#define OTYPE_MASK_UNIT (OTYPE_MASK(OTYPE_PLAYER) | OTYPE_MASK(OTYPE_CREATURE))
+
+// faction value used in query filter to accept any faction
+#define MAP_QUERY_ANY_FACTION 0xFFFFFFFF
+
+/*
+ * Structure containing filter used within map range queries
+ */
+struct MapQueryFilter
+{
+    MapQueryFilter(uint32_t _typeMask = OTYPE_MASK_ALL, uint32_t _faction = MAP_QUERY_ANY_FACTION, WorldObject* _exclude = nullptr) : typeMask(_typeMask), faction(_faction), exclude(_exclude) {};
+
+    // does the object pass the filter?
+    bool Matches(WorldObject* obj) const;
 
-typedef std::list<WorldObject*> WorldObjectList;
-typedef std::vector<WorldObjectList> WorldObjectMapRow;
-typedef std::vector<WorldObjectMapRow> WorldObjectMap;
+    // mask of accepted object types (see OTYPE_MASK macro)
+    uint32_t typeMask;
+    // accepted faction; when set, only units could pass the filter
+    uint32_t faction;
+    // object to be excluded from results (i.e. the one who is searching)
+    WorldObject* exclude;
+};
 
 /*
  * Structure containing pending removal from cell map
@@ -67,12 +124,14 @@ struct PendingCellRemoval
 class Map
 {
     public:
-        // constructor retaining map ID and pointer to storage record
-        Map(uint32_t id, MapRecord* mapTemplate = nullptr);
+        // constructor retaining map ID, pointer to storage record and instance ID
+        Map(uint32_t id, MapRecord* mapTemplate = nullptr, uint32_t instanceId = MAP_BASE_INSTANCE_ID);
         virtual ~Map();
 
         // initialize internal structures
         void InitContents();
+        // destroys all objects on map; players have to be removed before
+        void UnloadContents();
 
         // adds object to map
         void AddToMap(WorldObject* obj);
@@ -85,14 +144,31 @@ class Map
         void EnablePathfindCollision(WorldObject* obj);
         // removes object from pathfinding map
         void DisablePathfindCollision(WorldObject* obj);
-        // retrieves possible movement type for field supplied
-        uint32_t GetMovementTypeMaskFor(MapField* fld);
 
         // update objects on map
         virtual void Update();
 
+        // posts command to be executed at the beginning of next map update; has to be used for all map
+        // modifications originating outside of map update; may be called from any thread
+        void PostCommand(MapCommand const& command);
+        // posts command to be executed on object at the beginning of next map update; the command is dropped,
+        // if the object is no longer present in this map at that time
+        void PostObjectCommand(uint64_t guid, MapObjectCommand const& command);
+
+        // retrieves snapshot capturing changes during current update
+        WorldSnapshot& GetSnapshot();
+        // finishes snapshot of last update and starts a new one; the previous snapshot has to be sent already,
+        // and the finished one has to be sent, otherwise the send queues of its recipients would be stuck
+        WorldSnapshot* PublishSnapshot();
+
         // retrieves map ID
         uint32_t GetMapID();
+        // retrieves instance ID
+        uint32_t GetInstanceID();
+        // is this map an instance of map template?
+        bool IsInstance();
+        // was the map without players for at least supplied time (ms)?
+        bool IsIdle(uint32_t idleTime);
 
         // retrieves cell X index using X coordinate within cell
         uint32_t GetCellIndexX(float fieldX);
@@ -106,47 +182,111 @@ class Map
         // retrieves cell sorroundings, considering map size and boundaries
         void GetCellSorroundingLimits(uint32_t cellX, uint32_t cellY, uint32_t &beginX, uint32_t &beginY, uint32_t &endX, uint32_t &endY);
 
-        // sends packet to single cell
-        void SendPacketToCell(uint32_t cellX, uint32_t cellY, SmartPacket &pkt);
-        // sends packet to cell sorroundings
-        void SendPacketToSorroundings(uint32_t cellX, uint32_t cellY, SmartPacket &pkt);
-        // sends packet to position sorroundings
-        void SendPacketToSorroundings(float x, float y, SmartPacket &pkt);
-
-        // sends create packets for every object in sorrounding to player
-        void SendCreateSorroundings(Player* plr);
-        // when object enters cell, create him for objects there, and create objects for him
-        void SendCellCreatePacketsFor(uint32_t cellX, uint32_t cellY, WorldObject* wobj);
-        // when object leaves cell, delete him for objects there, and delete objects for him
-        void SendCellDeletePacketsFor(uint32_t cellX, uint32_t cellY, WorldObject* wobj);
+        // retrieves visibility distance of viewer at specified position; it's the configured distance, limited in dense areas
+        float GetVisibilityDistance(float x, float y);
+        // is the object visible for player?
+        bool IsVisibleFor(Player* plr, WorldObject* obj);
+        // updates visibility of object - creates/destroys objects for him (if player) and him for players around
+        void UpdateVisibilityOf(WorldObject* obj);
 
         // retrieves map field using game continuous coordinates
         MapField* GetField(float x, float y);
         // retrieves map field using absolute indexes
         MapField* GetFieldAbs(uint32_t x, uint32_t y);
-        // retrieves pathfinding map field; thread unsafe, use pathfindLayerMutex!
-        PathfindField* GetPathfindField(uint32_t x, uint32_t y);
+        // is the field accessible using any of movement types in mask? Use only within map update
+        bool IsPathfindAccessible(uint32_t x, uint32_t y, uint32_t moveMask);
+        // can object using any of movement types in mask move on field? Uses map definition only, not dynamic obstacles
+        bool CanMoveOn(float x, float y, uint32_t moveMask);
 
-        // mutex lock used when pathfinding is in progress (locks pathfind layer)
-        std::mutex pathfindLayerMutex;
+        // retrieves objects within radius from specified point
+        void GetObjectsInRange(float x, float y, float radius, WorldObjectVector &result, MapQueryFilter const& filter = MapQueryFilter());
+        // retrieves objects within box specified by its corners
+        void GetObjectsInBox(float x1, float y1, float x2, float y2, WorldObjectVector &result, MapQueryFilter const& filter = MapQueryFilter());
+        // retrieves nearest object within radius from specified point
+        WorldObject* GetNearestObject(float x, float y, float radius, MapQueryFilter const& filter = MapQueryFilter());
 
     protected:
         //
 
     private:
+        // inserts object to cell with specified position
+        void InsertToCell(uint32_t cellX, uint32_t cellY, WorldObject* obj, float x, float y);
+        // erases object from cell
+        void EraseFromCell(uint32_t cellX, uint32_t cellY, WorldObject* obj);
+        // retrieves index of object within cell, MAP_CELL_SLOT_NONE if not present
+        uint32_t FindCellSlot(uint32_t cellX, uint32_t cellY, WorldObject* obj);
+        // erases objects pending cell removal
+        void ProcessPendingCellRemovals();
+        // executes commands posted to map
+        void ProcessCommands();
+        // retrieves chunk of map template and keeps it loaded while the map exists; nullptr if not available
+        MapChunkRecord* GetChunk(uint32_t chunkX, uint32_t chunkY);
+        // makes sure all chunks covering specified field box are loaded
+        void LoadChunksInBox(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2);
+        // releases all chunks referenced by this map
+        void ReleaseChunks();
+        // retrieves fields covered by object collision box; returns false if the box lies outside the map
+        bool GetPathfindCollisionBox(WorldObject* obj, uint32_t &startX, uint32_t &startY, uint32_t &endX, uint32_t &endY);
+        // retrieves range of cells covering specified box; returns false if the box lies outside the map
+        bool GetCellRangeForBox(float x1, float y1, float x2, float y2, uint32_t &beginX, uint32_t &beginY, uint32_t &endX, uint32_t &endY);
+
+        // spawns contents of cells around supplied cell, and marks them active
+        void ActivateCellsAround(uint32_t cellX, uint32_t cellY);
+        // instantiates spawns of cell
+        void SpawnCell(uint32_t cellX, uint32_t cellY);
+        // destroys objects instantiated from cell spawns; objects which wandered to active cells are kept
+        void DespawnCell(uint32_t cellX, uint32_t cellY);
+        // was the cell far from any player for configured time?
+        bool IsCellIdle(uint32_t cellX, uint32_t cellY);
+        // destroys contents of cells, that were not near any player for configured time
+        void DespawnIdleCells();
+
+        // creates objects entering and destroys objects leaving visibility of player
+        void UpdateVisibilityForViewer(Player* plr);
+        // creates object for players who started to see it, and destroys it for those, who no longer see it
+        void UpdateWatchersOf(WorldObject* obj);
+        // captures packet for player to snapshot, so it's sent in order with captured object changes
+        void CapturePacketTo(Player* plr, SmartPacket &pkt);
+        // sends create packets for supplied objects to player (through snapshot)
+        void SendCreatePacketsTo(Player* plr, WorldObjectVector const& objects);
+        // sends destroy packets for supplied objects to player (through snapshot)
+        void SendDestroyPacketsTo(Player* plr, WorldObjectVector const& objects);
+        // subdivides dense cells and merges sparse ones
+        void RebuildVisibilitySubdivision();
+        // decides, whether to split visibility node or not, and does so recursively
+        void SubdivideVisibilityNode(MapCell &cell, uint32_t cellStartX, uint32_t cellStartY, uint8_t level, uint32_t nodeX, uint32_t nodeY, std::vector<uint32_t> const& indices, bool &changed);
+
         // map ID
         uint32_t m_mapId;
+        // instance ID
+        uint32_t m_instanceId;
         // stored pointer to map record
         MapRecord* m_storedMapRecord;
         // objects in map; key1 = cellX, key2 = cellY
-        WorldObjectMap m_objects;
-        // pathfinding layer
-        PathfindMap m_pathfindLayer;
+        MapCellGrid m_cells;
+        // pathfinding layer; shares unmodified pages with map template
+        PathfindLayer m_pathfindLayer;
+        // flags of map template chunks referenced by this map; index = chunkX * chunkCountY + chunkY
+        std::vector<bool> m_referencedChunks;
         // pending cell removal records
         std::list<PendingCellRemoval> m_pendingCellRemovals;
+        // configured visibility distance
+        float m_visibilityDistance;
+        // time of last visibility subdivision rebuild
+        uint32_t m_lastVisibilityRebuild;
+        // count of players on map
+        uint32_t m_playerCount;
+        // time when the last player left the map
+        uint32_t m_emptySince;
+        // time of last idle cell check
+        uint32_t m_lastCellDespawnCheck;
 
-        // map update mutex
-        std::recursive_mutex m_mapUpdateMutex;
+        // commands posted from outside of map update
+        MapCommandQueue m_commandQueue;
+        // double buffered snapshots; one is filled during update, while the other one (of previous update) is being sent
+        WorldSnapshot m_snapshots[2];
+        // index of snapshot being filled
+        uint32_t m_snapshotIndex;
 };
 
 #endif
@@ -0,0 +1,65 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "MapCommandQueue.h"
+
+MapCommandQueue::MapCommandQueue()
+{
+    // the queue always contains at least one (already consumed) node
+    Node* stub = new Node();
+    m_head.store(stub);
+    m_tail = stub;
+}
+
+MapCommandQueue::~MapCommandQueue()
+{
+    MapCommand command;
+    while (Pop(command))
+        ;
+
+    delete m_tail;
+}
+
+void MapCommandQueue::Push(MapCommand const& command)
+{
+    Node* node = new Node();
+    node->command = command;
+
+    // swap the head first, and link previous head to the new node after that; consumer won't
+    // see the new node until the link is stored
+    Node* prev = m_head.exchange(node, std::memory_order_acq_rel);
+    prev->next.store(node, std::memory_order_release);
+}
+
+bool MapCommandQueue::Pop(MapCommand& command)
+{
+    Node* next = m_tail->next.load(std::memory_order_acquire);
+    if (!next)
+        return false;
+
+    // the popped node becomes the new stub
+    command = std::move(next->command);
+    next->command = nullptr;
+
+    delete m_tail;
+    m_tail = next;
+
+    return true;
+}
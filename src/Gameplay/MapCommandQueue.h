@@ -0,0 +1,67 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_MAPCOMMANDQUEUE_H
+#define BW_MAPCOMMANDQUEUE_H
+
+#include <atomic>
+#include <functional>
+
+// command executed within map update
+typedef std::function<void()> MapCommand;
+
+/*
+ * Lock-free queue of commands posted to map; any thread may push commands, only the thread
+ * updating the map may pop them (multiple producers, single consumer)
+ */
+class MapCommandQueue
+{
+    public:
+        MapCommandQueue();
+        ~MapCommandQueue();
+
+        // enqueues command; may be called from any thread
+        void Push(MapCommand const& command);
+        // dequeues oldest command; returns false if there's none
+        bool Pop(MapCommand& command);
+
+    protected:
+        //
+
+    private:
+        /*
+         * Structure of queue node
+         */
+        struct Node
+        {
+            Node() : next(nullptr) {};
+
+            // next (newer) node
+            std::atomic<Node*> next;
+            // stored command
+            MapCommand command;
+        };
+
+        // most recently pushed node; shared by producers
+        std::atomic<Node*> m_head;
+        // last consumed node (or stub), its successor is the oldest command; owned by consumer
+        Node* m_tail;
+};
+
+#endif
@@ -22,6 +22,10 @@
 
 // version magic used in files
 #define MAP_VERSION_MAGIC 0x000100FF
+// version magic used in chunk-blocked files, that could be mapped to memory and used in place
+#define MAP_VERSION_MAGIC_V2 0x000200FF
+// alignment of chunk data within chunk-blocked map files
+#define MAP_FILE_DATA_ALIGNMENT 4096
 
 // default field type
 #define DEFAULT_FIELD_TYPE          MFT_WATER
@@ -48,8 +52,41 @@
 // how many cells are considered "sorrounding" in Y direction
 #define MAP_SORROUNDING_CELLS_Y 2
 
-// how many object updates should be in single packet
-#define UPDATEPACKET_COUNT_LIMIT 50
+// maximum visibility distance; nobody sees further than cell sorroundings
+#define MAP_VISIBILITY_DISTANCE_MAX (MAP_SORROUNDING_CELLS_X * MAP_CELL_SIZE_X)
+// extra distance, after which visible object is destroyed for player
+#define MAP_VISIBILITY_HYSTERESIS 2.0f
+// distance the object needs to travel to update its visibility
+#define MAP_VISIBILITY_UPDATE_DISTANCE 2.0f
+
+// maximum visibility subdivision level of cell (node size is halved with every level)
+#define MAP_VISIBILITY_MAX_LEVEL 3
+// count of smallest visibility nodes per cell side
+#define MAP_VISIBILITY_GRID_SIZE (1 << MAP_VISIBILITY_MAX_LEVEL)
+// smallest visibility node size (field count)
+#define MAP_VISIBILITY_NODE_MIN_SIZE_X (MAP_CELL_SIZE_X / MAP_VISIBILITY_GRID_SIZE)
+// smallest visibility node size (field count)
+#define MAP_VISIBILITY_NODE_MIN_SIZE_Y (MAP_CELL_SIZE_Y / MAP_VISIBILITY_GRID_SIZE)
+// object count within visibility node needed to subdivide it
+#define MAP_VISIBILITY_SPLIT_THRESHOLD 64
+// object count within subdivided visibility node, under which the node is merged back
+#define MAP_VISIBILITY_MERGE_THRESHOLD 32
+// interval of visibility subdivision rebuild (ms)
+#define MAP_VISIBILITY_REBUILD_INTERVAL 1000
+
+// interval of looking for cells, that are no longer near any player (ms)
+#define MAP_CELL_DESPAWN_CHECK_INTERVAL 5000
+
+// cell slot value used when the object is not present in cell
+#define MAP_CELL_SLOT_NONE 0xFFFFFFFF
+
+// instance ID of base (non-instanced) map
+#define MAP_BASE_INSTANCE_ID 0
+
+// how many object updates could be in single packet (count is sent as 8bit value)
+#define UPDATEPACKET_COUNT_LIMIT 255
+// size of create/destroy packet, after which no more objects are added and the next packet is started
+#define UPDATEPACKET_SIZE_LIMIT 32768
 
 // width of map field
 #define MAP_FIELD_PX_SIZE_X 32
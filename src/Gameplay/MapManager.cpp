@@ -20,24 +20,168 @@
 #include "General.h"
 #include "MapManager.h"
 #include "MapStorage.h"
+#include "ObjectAccessor.h"
+#include "Player.h"
+#include "Session.h"
+#include "Config.h"
+#include "ThreadPool.h"
+#include "GuidLease.h"
 #include "Log.h"
 
+#include <sstream>
+
 MapManager::MapManager()
 {
-    //
+    m_nextInstanceId = MAP_BASE_INSTANCE_ID + 1;
+    m_running = false;
+    m_loaderThread = nullptr;
+    m_snapshotPool = nullptr;
 }
 
 MapManager::~MapManager()
 {
-    //
+    Shutdown();
+}
+
+void MapManager::Shutdown()
+{
+    if (m_loaderThread)
+    {
+        {
+            std::unique_lock<std::mutex> lck(m_loaderMutex);
+            m_running = false;
+            m_loadRequestCond.notify_all();
+        }
+
+        m_loaderThread->join();
+        delete m_loaderThread;
+        m_loaderThread = nullptr;
+    }
+
+    // finishes snapshots being sent; workers return their leased GUIDs when they exit
+    delete m_snapshotPool;
+    m_snapshotPool = nullptr;
+}
+
+bool MapManager::Init()
+{
+    m_running = true;
+    m_loaderThread = new std::thread(&MapManager::LoaderUpdate, this);
+
+    m_snapshotPool = new ThreadPool();
+
+    // pre-warmed maps are listed in format "mapId,mapId,..."
+    std::stringstream prewarm(sConfig->GetStringValue(CONFIG_STRING_MAP_PREWARM));
+    std::string item;
+    int64_t mapId;
+
+    while (std::getline(prewarm, item, ','))
+    {
+        if (!str2int(mapId, str_trim(item).c_str()))
+            continue;
+
+        if (!RequestMap((uint32_t)mapId))
+        {
+            sLog->Error("Map %u configured for pre-warming does not exist", (uint32_t)mapId);
+            continue;
+        }
+
+        m_prewarmMaps.insert((uint32_t)mapId);
+    }
+
+    if (!m_prewarmMaps.empty())
+        sLog->Info("Requested %u maps to be pre-warmed", (uint32_t)m_prewarmMaps.size());
+
+    return true;
 }
 
-Map* MapManager::GetMap(uint32_t mapId)
+Map* MapManager::GetMap(uint32_t mapId, uint32_t instanceId)
 {
     // if exists, return the instance
-    if (m_createdMaps.find(mapId) != m_createdMaps.end())
-        return m_createdMaps[mapId];
+    Map* map = FindMap(mapId, instanceId);
+    if (map)
+        return map;
+
+    // instances are created explicitly, only base map is created on demand
+    if (instanceId != MAP_BASE_INSTANCE_ID)
+        return nullptr;
+
+    // the loader thread is already working on it
+    uint64_t key = MAP_INSTANCE_KEY(mapId, instanceId);
+    if (m_pendingMaps.find(key) != m_pendingMaps.end())
+    {
+        WaitForLoadedMap(key);
+        return FindMap(mapId, instanceId);
+    }
+
+    return CreateMap(mapId, instanceId);
+}
+
+Map* MapManager::FindMap(uint32_t mapId, uint32_t instanceId)
+{
+    std::unordered_map<uint64_t, Map*>::iterator itr = m_createdMaps.find(MAP_INSTANCE_KEY(mapId, instanceId));
+    if (itr != m_createdMaps.end())
+        return itr->second;
+
+    return nullptr;
+}
 
+bool MapManager::CanEnterMap(uint32_t mapId, uint32_t instanceId)
+{
+    if (FindMap(mapId, instanceId))
+        return true;
+
+    return (instanceId == MAP_BASE_INSTANCE_ID && sMapStorage->GetMapRecord(mapId) != nullptr);
+}
+
+bool MapManager::RequestMap(uint32_t mapId)
+{
+    uint64_t key = MAP_INSTANCE_KEY(mapId, MAP_BASE_INSTANCE_ID);
+
+    // already created or requested
+    if (m_createdMaps.find(key) != m_createdMaps.end() || m_pendingMaps.find(key) != m_pendingMaps.end())
+        return true;
+
+    if (!sMapStorage->GetMapRecord(mapId))
+        return false;
+
+    // without loader thread, the map is created right away
+    if (!m_running)
+        return (CreateMap(mapId, MAP_BASE_INSTANCE_ID) != nullptr);
+
+    m_pendingMaps.insert(key);
+
+    std::unique_lock<std::mutex> lck(m_loaderMutex);
+
+    m_loadQueue.push(key);
+    m_loadRequestCond.notify_all();
+
+    return true;
+}
+
+Map* MapManager::CreateInstance(uint32_t mapId)
+{
+    Map* map = CreateMap(mapId, m_nextInstanceId);
+    if (map)
+        m_nextInstanceId++;
+
+    return map;
+}
+
+Map* MapManager::CreateMap(uint32_t mapId, uint32_t instanceId)
+{
+    Map* map = BuildMap(mapId, instanceId);
+    if (!map)
+        return nullptr;
+
+    // store into manager's map
+    m_createdMaps[MAP_INSTANCE_KEY(mapId, instanceId)] = map;
+
+    return map;
+}
+
+Map* MapManager::BuildMap(uint32_t mapId, uint32_t instanceId)
+{
     // retrieve map record
     MapRecord* mrec = sMapStorage->GetMapRecord(mapId);
     if (!mrec)
@@ -47,17 +191,204 @@ Map* MapManager::GetMap(uint32_t mapId)
     }
 
     // create new map
-    Map* map = new Map(mapId, mrec);
+    Map* map = new Map(mapId, mrec, instanceId);
     // init contents
     map->InitContents();
-    // store into manager's map
-    m_createdMaps[mapId] = map;
 
     return map;
 }
 
+void MapManager::LoaderUpdate()
+{
+    uint64_t key;
+    Map* map;
+
+    // spawned objects take GUIDs from loader's own lease; unused GUIDs are returned when the loader exits
+    GuidLease guidLease;
+    guidLease.Bind();
+
+    std::unique_lock<std::mutex> lck(m_loaderMutex);
+
+    while (true)
+    {
+        // the flag is checked under lock, so the shutdown notification could not be missed
+        m_loadRequestCond.wait(lck, [this] { return !m_running || !m_loadQueue.empty(); });
+        if (!m_running)
+            return;
+
+        key = m_loadQueue.front();
+        m_loadQueue.pop();
+
+        // build the map without holding the lock, so the main thread could request more maps
+        lck.unlock();
+        map = BuildMap(MAP_INSTANCE_KEY_MAP(key), MAP_INSTANCE_KEY_INSTANCE(key));
+        lck.lock();
+
+        // failures are reported too, so nobody waits for the map forever
+        m_loadedMaps.push_back(std::make_pair(key, map));
+        m_loadFinishedCond.notify_all();
+    }
+}
+
+void MapManager::WaitForLoadedMap(uint64_t key)
+{
+    while (m_pendingMaps.find(key) != m_pendingMaps.end())
+    {
+        {
+            std::unique_lock<std::mutex> lck(m_loaderMutex);
+            while (m_loadedMaps.empty())
+                m_loadFinishedCond.wait(lck);
+        }
+
+        PublishLoadedMaps();
+    }
+}
+
+void MapManager::PublishLoadedMaps()
+{
+    std::list<std::pair<uint64_t, Map*>> loaded;
+
+    // take finished maps at once
+    {
+        std::unique_lock<std::mutex> lck(m_loaderMutex);
+        if (m_loadedMaps.empty())
+            return;
+
+        loaded.swap(m_loadedMaps);
+    }
+
+    uint64_t key;
+    Map* map;
+    WorldObject* obj;
+    std::set<uint64_t> waitingGuids;
+
+    for (std::pair<uint64_t, Map*>& result : loaded)
+    {
+        key = result.first;
+        map = result.second;
+
+        if (map)
+            m_createdMaps[key] = map;
+        else
+            sLog->Error("Could not load map %u (instance %u)", MAP_INSTANCE_KEY_MAP(key), MAP_INSTANCE_KEY_INSTANCE(key));
+
+        m_pendingMaps.erase(key);
+
+        // take players waiting for this map
+        std::map<uint64_t, std::set<uint64_t>>::iterator itr = m_pendingPlayers.find(key);
+        if (itr == m_pendingPlayers.end())
+            continue;
+
+        waitingGuids.clear();
+        waitingGuids.swap(itr->second);
+        m_pendingPlayers.erase(itr);
+
+        for (uint64_t guid : waitingGuids)
+        {
+            obj = sObjectAccessor->FindWorldObject(guid);
+            if (!obj || obj->GetType() != OTYPE_PLAYER || !obj->ToPlayer()->GetSession())
+                continue;
+
+            // the player has nowhere to go
+            if (!map)
+            {
+                obj->ToPlayer()->GetSession()->Kick();
+                continue;
+            }
+
+            obj->ToPlayer()->GetSession()->SetConnectionState(CONNECTION_STATE_INGAME);
+            AddToMapDeferred(map, obj);
+        }
+    }
+}
+
+void MapManager::AddPlayerToMap(Player* plr)
+{
+    Map* map = FindMap(plr->GetMapId(), plr->GetInstanceId());
+    if (map)
+    {
+        plr->GetSession()->SetConnectionState(CONNECTION_STATE_INGAME);
+        AddToMapDeferred(map, plr);
+        return;
+    }
+
+    // only base maps are created on demand
+    if (plr->GetInstanceId() != MAP_BASE_INSTANCE_ID || !RequestMap(plr->GetMapId()))
+    {
+        sLog->Error("Could not add player %s to map %u (instance %u), that doesn't exist", plr->GetName(), plr->GetMapId(), plr->GetInstanceId());
+        return;
+    }
+
+    // the map may have been created right away
+    map = FindMap(plr->GetMapId(), plr->GetInstanceId());
+    if (map)
+    {
+        plr->GetSession()->SetConnectionState(CONNECTION_STATE_INGAME);
+        AddToMapDeferred(map, plr);
+        return;
+    }
+
+    plr->GetSession()->SetConnectionState(CONNECTION_STATE_LOADING);
+    m_pendingPlayers[MAP_INSTANCE_KEY(plr->GetMapId(), plr->GetInstanceId())].insert(plr->GetGUID());
+}
+
+void MapManager::AddToMapDeferred(Map* map, WorldObject* obj)
+{
+    // the object is added within map update; its map and position could not change meanwhile, since it's not in any map
+    map->PostCommand([map, obj]() {
+        map->AddToMap(obj);
+    });
+}
+
+void MapManager::CancelPendingPlayer(Player* plr)
+{
+    std::map<uint64_t, std::set<uint64_t>>::iterator itr = m_pendingPlayers.find(MAP_INSTANCE_KEY(plr->GetMapId(), plr->GetInstanceId()));
+    if (itr != m_pendingPlayers.end())
+        itr->second.erase(plr->GetGUID());
+}
+
 void MapManager::UpdateMaps()
 {
-    for (std::unordered_map<uint32_t, Map*>::iterator itr = m_createdMaps.begin(); itr != m_createdMaps.end(); ++itr)
+    // configured in minutes, 0 = never unload
+    uint32_t idleTime = (uint32_t)sConfig->GetIntValue(CONFIG_INT_MAP_UNLOAD_IDLE_TIME) * 60 * 1000;
+
+    // maps finished in background are available since now
+    PublishLoadedMaps();
+
+    for (std::unordered_map<uint64_t, Map*>::iterator itr = m_createdMaps.begin(); itr != m_createdMaps.end(); ++itr)
         itr->second->Update();
+
+    // snapshots of previous update were being sent while maps were updated; they have to be finished
+    // before their buffers are reused or their maps unloaded
+    m_snapshotPool->Wait();
+
+    // send snapshots of all maps in parallel with next update; packets sent meanwhile are queued
+    // behind places reserved by snapshots, so the clients still receive them in order
+    WorldSnapshot* snapshot;
+    for (std::unordered_map<uint64_t, Map*>::iterator itr = m_createdMaps.begin(); itr != m_createdMaps.end(); )
+    {
+        snapshot = itr->second->PublishSnapshot();
+
+        // unload maps without players; base maps are created again on demand, pre-warmed maps stay loaded
+        if (idleTime > 0 && itr->second->IsIdle(idleTime) && m_prewarmMaps.find(itr->second->GetMapID()) == m_prewarmMaps.end())
+        {
+            sLog->Info("Unloading idle map %u (instance %u)", itr->second->GetMapID(), itr->second->GetInstanceID());
+
+            // the snapshot would be destroyed with the map
+            if (!snapshot->IsEmpty())
+                snapshot->Send();
+
+            delete itr->second;
+            itr = m_createdMaps.erase(itr);
+            continue;
+        }
+
+        if (!snapshot->IsEmpty())
+            m_snapshotPool->Enqueue([snapshot]() { snapshot->Send(); });
+
+        ++itr;
+    }
+
+    // chunks released by unloaded maps are unloaded after a while
+    sMapStorage->UnloadUnusedChunks();
 }
@@ -23,6 +23,19 @@
 #include "Singleton.h"
 #include "Map.h"
 
+#include <atomic>
+
+class ThreadPool;
+
+// builds key of map instance within created maps
+#define MAP_INSTANCE_KEY(mapId, instanceId) ((((uint64_t)mapId) << 32LL) | ((uint64_t)instanceId))
+// retrieves map ID from map instance key
+#define MAP_INSTANCE_KEY_MAP(key) ((uint32_t)((key) >> 32LL))
+// retrieves instance ID from map instance key
+#define MAP_INSTANCE_KEY_INSTANCE(key) ((uint32_t)((key) & 0xFFFFFFFF))
+
+class Player;
+
 /*
  * Singleton class used for maintaining all active maps
  */
@@ -32,18 +45,76 @@ class MapManager
     public:
         ~MapManager();
 
-        // retrieves map; if not created, create it
-        Map* GetMap(uint32_t mapId);
+        // starts map loader thread and requests configured maps to be loaded
+        bool Init();
+        // stops map loader thread and snapshot sending threads; their leased GUIDs are returned to guidspace
+        void Shutdown();
+
+        // retrieves map; if not created and the base map is requested, create it (or wait for loader thread to finish it)
+        Map* GetMap(uint32_t mapId, uint32_t instanceId = MAP_BASE_INSTANCE_ID);
+        // retrieves map, only if it's already created
+        Map* FindMap(uint32_t mapId, uint32_t instanceId = MAP_BASE_INSTANCE_ID);
+        // could the map be entered? (it's created, or it's base map, that could be created)
+        bool CanEnterMap(uint32_t mapId, uint32_t instanceId = MAP_BASE_INSTANCE_ID);
+        // requests base map to be created in loader thread; returns false if the map does not exist
+        bool RequestMap(uint32_t mapId);
+        // creates new instance of map
+        Map* CreateInstance(uint32_t mapId);
         // update all loaded maps
         void UpdateMaps();
 
+        // adds player to his stored map; if not created yet, the player waits in loading state, until the loader thread finishes it
+        void AddPlayerToMap(Player* plr);
+        // cancels waiting of player for his map
+        void CancelPendingPlayer(Player* plr);
+
+        // loads requested maps (called from loader thread)
+        void LoaderUpdate();
+
     protected:
         // protected singleton constructor
         MapManager();
 
     private:
-        // all created maps map
-        std::unordered_map<uint32_t, Map*> m_createdMaps;
+        // creates map and initializes its contents
+        Map* CreateMap(uint32_t mapId, uint32_t instanceId);
+        // builds map and its contents, without publishing it; safe to call from loader thread
+        Map* BuildMap(uint32_t mapId, uint32_t instanceId);
+        // publishes maps finished by loader thread and adds waiting players to them
+        void PublishLoadedMaps();
+        // posts command adding object to map within its next update
+        void AddToMapDeferred(Map* map, WorldObject* obj);
+        // waits for loader thread to finish map
+        void WaitForLoadedMap(uint64_t key);
+
+        // all created maps map; key = MAP_INSTANCE_KEY(mapId, instanceId)
+        std::unordered_map<uint64_t, Map*> m_createdMaps;
+        // next instance ID to be assigned
+        uint32_t m_nextInstanceId;
+        // maps, that are kept loaded even without players
+        std::set<uint32_t> m_prewarmMaps;
+
+        // is loader thread supposed to be running?
+        std::atomic<bool> m_running;
+        // map loader thread instance
+        std::thread* m_loaderThread;
+        // condition variable for waiting when no map is requested
+        std::condition_variable m_loadRequestCond;
+        // condition variable for waiting for finished map
+        std::condition_variable m_loadFinishedCond;
+        // loader monitor mutex
+        std::mutex m_loaderMutex;
+        // map keys requested to be loaded (guarded by loader mutex)
+        std::queue<uint64_t> m_loadQueue;
+        // maps finished by loader thread along with their keys, not yet published; nullptr if the map could not be built (guarded by loader mutex)
+        std::list<std::pair<uint64_t, Map*>> m_loadedMaps;
+        // keys of maps requested and not yet published
+        std::set<uint64_t> m_pendingMaps;
+        // GUIDs of players waiting for map; key = MAP_INSTANCE_KEY(mapId, instanceId)
+        std::map<uint64_t, std::set<uint64_t>> m_pendingPlayers;
+
+        // pool of threads sending map snapshots while maps are being updated
+        ThreadPool* m_snapshotPool;
 };
 
 #define sMapManager Singleton<MapManager>::getInstance()
@@ -22,6 +22,9 @@
 #include "Log.h"
 #include "WorldObject.h"
 #include "DatabaseConnection.h"
+#include "EpochManager.h"
+#include "Config.h"
+#include "GuidLease.h"
 
 // guid map granularities - how many "bits" should be allocated at once
 
@@ -30,6 +33,23 @@
 #define GUIDMAP_GRANULARITY_PLAYER 1024
 #define GUIDMAP_GRANULARITY_ITEM 8092
 
+/*
+ * Structure describing guidmap stored in guidspace snapshot
+ */
+struct GuidMapSnapshotTable
+{
+    // guidmap type
+    GUIDMapType type;
+    // table the guidmap is built from
+    const char* table;
+};
+
+// guidmaps stored in snapshot; spawn tables are static world data, so only tables growing with every assigned GUID are here
+static const GuidMapSnapshotTable guidMapSnapshotTables[] = {
+    { GUIDMAP_PLAYER, "characters" },
+    { GUIDMAP_ITEM, "item" }
+};
+
 ObjectAccessor::ObjectAccessor()
 {
     //
@@ -37,7 +57,11 @@ ObjectAccessor::ObjectAccessor()
 
 ObjectAccessor::~ObjectAccessor()
 {
-    //
+    for (uint32_t i = 0; i < MAX_HIGHGUID; i++)
+    {
+        for (ObjectSlot* page : m_objectSlotPages[i])
+            delete[] page;
+    }
 }
 
 void ObjectAccessor::InitGUIDMaps()
@@ -50,6 +74,10 @@ void ObjectAccessor::InitGUIDMaps()
     m_guidMap[GUIDMAP_PLAYER].Init(GUIDMAP_GRANULARITY_PLAYER);
     m_guidMap[GUIDMAP_ITEM].Init(GUIDMAP_GRANULARITY_ITEM);
 
+    // restore guidmaps stored on last shutdown, if the tables haven't changed since then
+    bool loaded[MAX_GUIDMAP] = { false };
+    LoadGUIDMapSnapshot(loaded);
+
     // then go through existing records in database and set occupied GUIDs so they won't be assigned again
 
     DBResult res;
@@ -62,46 +90,241 @@ void ObjectAccessor::InitGUIDMaps()
     while (res.FetchRow())
         m_guidMap[GUIDMAP_GAMEOBJECT].SetBit(res.GetUInt32(0));
 
-    res = sMainDatabase.PQuery("SELECT guid FROM characters");
-    while (res.FetchRow())
-        m_guidMap[GUIDMAP_PLAYER].SetBit(res.GetUInt32(0));
+    if (!loaded[GUIDMAP_PLAYER])
+    {
+        res = sMainDatabase.PQuery("SELECT guid FROM characters");
+        while (res.FetchRow())
+            m_guidMap[GUIDMAP_PLAYER].SetBit(res.GetUInt32(0));
+    }
 
-    res = sMainDatabase.PQuery("SELECT guid FROM item");
-    while (res.FetchRow())
-        m_guidMap[GUIDMAP_ITEM].SetBit(res.GetUInt32(0));
+    if (!loaded[GUIDMAP_ITEM])
+    {
+        res = sMainDatabase.PQuery("SELECT guid FROM item");
+        while (res.FetchRow())
+            m_guidMap[GUIDMAP_ITEM].SetBit(res.GetUInt32(0));
+    }
 
     sLog->Info("Guidspace successfully initialized");
 }
 
+bool ObjectAccessor::GetGUIDTableState(const char* table, uint64_t& rowCount, uint64_t& maxGuid)
+{
+    DBResult res = sMainDatabase.PQuery("SELECT COUNT(*), COALESCE(MAX(guid), 0) FROM %s", table);
+    if (!res.FetchRow())
+        return false;
+
+    rowCount = res.GetUInt64(0);
+    maxGuid = res.GetUInt64(1);
+    return true;
+}
+
+void ObjectAccessor::LoadGUIDMapSnapshot(bool* loaded)
+{
+    std::string path = sConfig->GetStringValue(CONFIG_STRING_GUIDMAP_SNAPSHOT_FILE);
+    if (path.empty())
+        return;
+
+    // the snapshot exists only after clean shutdown
+    FILE* f = fopen(path.c_str(), "rb");
+    if (!f)
+        return;
+
+    uint32_t magic, type;
+    uint64_t rowCount, maxGuid, dbRowCount, dbMaxGuid;
+
+    if (fread(&magic, sizeof(uint32_t), 1, f) != 1 || magic != GUIDMAP_SNAPSHOT_MAGIC)
+        sLog->Error("Invalid guidspace snapshot file %s", path.c_str());
+    else
+    {
+        for (const GuidMapSnapshotTable& snapTable : guidMapSnapshotTables)
+        {
+            if (fread(&type, sizeof(uint32_t), 1, f) != 1 || type != (uint32_t)snapTable.type
+                || fread(&rowCount, sizeof(uint64_t), 1, f) != 1 || fread(&maxGuid, sizeof(uint64_t), 1, f) != 1)
+            {
+                sLog->Error("Invalid guidspace snapshot file %s", path.c_str());
+                break;
+            }
+
+            // the table has been modified outside of server since the snapshot was taken
+            if (!GetGUIDTableState(snapTable.table, dbRowCount, dbMaxGuid) || dbRowCount != rowCount || dbMaxGuid != maxGuid)
+            {
+                sLog->Info("Guidspace snapshot of table %s is outdated", snapTable.table);
+                break;
+            }
+
+            if (!m_guidMap[snapTable.type].LoadFromFile(f))
+            {
+                sLog->Error("Could not load guidspace snapshot of table %s", snapTable.table);
+                break;
+            }
+
+            loaded[snapTable.type] = true;
+            sLog->Info("Loaded guidspace of table %s from snapshot", snapTable.table);
+        }
+    }
+
+    fclose(f);
+
+    // the snapshot gets outdated with the first assigned GUID; when the server crashes, it must not be used again
+    remove(path.c_str());
+}
+
+void ObjectAccessor::SaveGUIDMapSnapshot()
+{
+    std::string path = sConfig->GetStringValue(CONFIG_STRING_GUIDMAP_SNAPSHOT_FILE);
+    if (path.empty())
+        return;
+
+    FILE* f = fopen(path.c_str(), "wb");
+    if (!f)
+    {
+        sLog->Error("Could not write guidspace snapshot file %s", path.c_str());
+        return;
+    }
+
+    std::unique_lock<std::mutex> lck(m_guidMapMutex);
+
+    uint32_t magic = GUIDMAP_SNAPSHOT_MAGIC, type;
+    uint64_t rowCount, maxGuid;
+    bool success = (fwrite(&magic, sizeof(uint32_t), 1, f) == 1);
+
+    for (const GuidMapSnapshotTable& snapTable : guidMapSnapshotTables)
+    {
+        if (!success)
+            break;
+
+        // record table state, so the snapshot could be validated on startup
+        type = (uint32_t)snapTable.type;
+        success = GetGUIDTableState(snapTable.table, rowCount, maxGuid)
+            && fwrite(&type, sizeof(uint32_t), 1, f) == 1
+            && fwrite(&rowCount, sizeof(uint64_t), 1, f) == 1
+            && fwrite(&maxGuid, sizeof(uint64_t), 1, f) == 1
+            && m_guidMap[snapTable.type].SaveToFile(f);
+    }
+
+    fclose(f);
+
+    if (!success)
+    {
+        sLog->Error("Could not write guidspace snapshot file %s", path.c_str());
+        remove(path.c_str());
+    }
+}
+
+ObjectSlot* ObjectAccessor::GetObjectSlot(uint64_t guid, bool create)
+{
+    uint32_t high = EXTRACT_GUIDHIGH(guid);
+    if (high >= MAX_HIGHGUID)
+        return nullptr;
+
+    uint32_t low = EXTRACT_GUIDLOW(guid);
+    uint32_t pageIndex = low >> OBJECT_SLOT_PAGE_SHIFT;
+
+    std::vector<ObjectSlot*>& pages = m_objectSlotPages[high];
+
+    if (pageIndex >= pages.size() || !pages[pageIndex])
+    {
+        if (!create)
+            return nullptr;
+
+        if (pageIndex >= pages.size())
+            pages.resize(pageIndex + 1, nullptr);
+
+        // zeroed page - no objects, generation 0
+        pages[pageIndex] = new ObjectSlot[OBJECT_SLOT_PAGE_SIZE]();
+    }
+
+    return &pages[pageIndex][low & OBJECT_SLOT_PAGE_MASK];
+}
+
 void ObjectAccessor::AddObject(uint64_t guid, WorldObject* obj)
 {
+    ObjectSlot* slot = GetObjectSlot(guid, true);
+    if (!slot)
+    {
+        sLog->Error("Attempted to add object with invalid guid (%llu)!", guid);
+        return;
+    }
+
     // do not allow to store same GUID twice
-    if (m_objectMap.find(guid) != m_objectMap.end())
+    if (slot->object)
     {
         sLog->Error("Attempted to add object with the same guid (%llu) more than once!", guid);
         return;
     }
 
-    m_objectMap[guid] = obj;
+    slot->object = obj;
+    slot->guid = guid;
 }
 
 void ObjectAccessor::RemoveObject(uint64_t guid)
 {
-    if (m_objectMap.find(guid) != m_objectMap.end())
-        m_objectMap.erase(guid);
+    ObjectSlot* slot = GetObjectSlot(guid);
+    if (!slot || !slot->object || slot->guid != guid)
+        return;
+
+    slot->object = nullptr;
+    slot->guid = 0;
+    // invalidate all handles obtained so far
+    slot->generation++;
+}
+
+void ObjectAccessor::RetireObject(WorldObject* obj, bool releaseGuid)
+{
+    uint64_t guid = obj->GetGUID();
+
+    // nobody could find the object since now, but others may still hold pointer to it until they pass quiescent point
+    RemoveObject(guid);
+
+    sEpochManager->Retire([this, obj, guid, releaseGuid]() {
+        // the GUID could not be assigned again while stale references exist
+        if (releaseGuid)
+            ReleaseGUID(guid);
+
+        DestroyObject(obj);
+    });
+}
+
+void ObjectAccessor::DestroyObject(WorldObject* obj)
+{
+    // object memory returns to slab allocator, which keeps it poisoned for a while in debug build
+    delete obj;
 }
 
 WorldObject* ObjectAccessor::FindWorldObject(uint64_t guid)
 {
-    if (m_objectMap.find(guid) == m_objectMap.end())
+    ObjectSlot* slot = GetObjectSlot(guid);
+
+    // the slot may be occupied by object with another entry part of GUID
+    if (!slot || slot->guid != guid)
+        return nullptr;
+
+    return slot->object;
+}
+
+WorldObject* ObjectAccessor::FindWorldObject(ObjectHandle const& handle)
+{
+    ObjectSlot* slot = GetObjectSlot(handle.guid);
+
+    if (!slot || slot->guid != handle.guid || slot->generation != handle.generation)
         return nullptr;
 
-    return m_objectMap[guid];
+    return slot->object;
+}
+
+ObjectHandle ObjectAccessor::GetObjectHandle(uint64_t guid)
+{
+    ObjectSlot* slot = GetObjectSlot(guid);
+
+    if (!slot || !slot->object || slot->guid != guid)
+        return ObjectHandle();
+
+    return ObjectHandle(guid, slot->generation);
 }
 
 uint64_t ObjectAccessor::AllocateCreatureGUID(uint32_t entry)
 {
-    int64_t guid = m_guidMap[GUIDMAP_CREATURE].UseEmpty();
+    int64_t guid = UseGUID(GUIDMAP_CREATURE);
     if (guid == -1)
     {
         sLog->Error("Could not allocate next creature GUID!");
@@ -114,7 +337,7 @@ uint64_t ObjectAccessor::AllocateCreatureGUID(uint32_t entry)
 
 uint64_t ObjectAccessor::AllocateGameobjectGUID(uint32_t entry)
 {
-    int64_t guid = m_guidMap[GUIDMAP_GAMEOBJECT].UseEmpty();
+    int64_t guid = UseGUID(GUIDMAP_GAMEOBJECT);
     if (guid == -1)
     {
         sLog->Error("Could not allocate next gameobject GUID!");
@@ -127,7 +350,7 @@ uint64_t ObjectAccessor::AllocateGameobjectGUID(uint32_t entry)
 
 uint64_t ObjectAccessor::AllocatePlayerGUID()
 {
-    int64_t guid = m_guidMap[GUIDMAP_PLAYER].UseEmpty();
+    int64_t guid = UseGUID(GUIDMAP_PLAYER);
     if (guid == -1)
     {
         sLog->Error("Could not allocate next player GUID!");
@@ -140,7 +363,7 @@ uint64_t ObjectAccessor::AllocatePlayerGUID()
 
 uint32_t ObjectAccessor::AllocateItemGUID()
 {
-    int64_t guid = m_guidMap[GUIDMAP_ITEM].UseEmpty();
+    int64_t guid = UseGUID(GUIDMAP_ITEM);
     // limit item GUIDs to uint32 maximum
     if (guid == -1 || guid >= UINT32_MAX)
     {
@@ -151,3 +374,66 @@ uint32_t ObjectAccessor::AllocateItemGUID()
 
     return (uint32_t)guid;
 }
+
+void ObjectAccessor::ReleaseGUID(uint64_t guid)
+{
+    std::unique_lock<std::mutex> lck(m_guidMapMutex);
+
+    switch (EXTRACT_GUIDHIGH(guid))
+    {
+        case HIGHGUID_CREATURE:
+            m_guidMap[GUIDMAP_CREATURE].ClearBit(EXTRACT_GUIDLOW(guid));
+            break;
+        case HIGHGUID_GAMEOBJECT:
+            m_guidMap[GUIDMAP_GAMEOBJECT].ClearBit(EXTRACT_GUIDLOW(guid));
+            break;
+        default:
+            sLog->Error("Attempted to release GUID %llu of unsupported type", guid);
+            break;
+    }
+}
+
+void ObjectAccessor::ReleaseItemGUID(uint32_t guid)
+{
+    std::unique_lock<std::mutex> lck(m_guidMapMutex);
+
+    m_guidMap[GUIDMAP_ITEM].ClearBit(guid);
+}
+
+int64_t ObjectAccessor::UseGUID(GUIDMapType type)
+{
+    // hot path - no locking at all
+    if (GuidLease* lease = GuidLease::GetCurrent())
+        return lease->Use(type);
+
+    std::unique_lock<std::mutex> lck(m_guidMapMutex);
+
+    return m_guidMap[type].UseEmpty();
+}
+
+uint32_t ObjectAccessor::LeaseGUIDs(GUIDMapType type, int64_t* guids, uint32_t count)
+{
+    std::unique_lock<std::mutex> lck(m_guidMapMutex);
+
+    uint32_t taken = 0, found;
+
+    // every step takes free GUIDs of one bitmap word
+    while (taken < count)
+    {
+        found = m_guidMap[type].UseEmptyRange(guids + taken, count - taken);
+        if (found == 0)
+            break;
+
+        taken += found;
+    }
+
+    return taken;
+}
+
+void ObjectAccessor::ReturnGUIDs(GUIDMapType type, const int64_t* guids, uint32_t count)
+{
+    std::unique_lock<std::mutex> lck(m_guidMapMutex);
+
+    for (uint32_t i = 0; i < count; i++)
+        m_guidMap[type].ClearBit(guids[i]);
+}
@@ -22,9 +22,50 @@
 
 #include "Singleton.h"
 #include "GuidMap.h"
+#include "ObjectEnums.h"
 
 class WorldObject;
 
+// guidspace snapshot file signature
+#define GUIDMAP_SNAPSHOT_MAGIC 0x53475742
+
+// bit shift of object slot page index within low GUID
+#define OBJECT_SLOT_PAGE_SHIFT 10
+// count of object slots in one page
+#define OBJECT_SLOT_PAGE_SIZE (1 << OBJECT_SLOT_PAGE_SHIFT)
+// mask of object slot index within page
+#define OBJECT_SLOT_PAGE_MASK (OBJECT_SLOT_PAGE_SIZE - 1)
+
+/*
+ * Structure of object slot, indexed by low part of GUID
+ */
+struct ObjectSlot
+{
+    // object occupying the slot, nullptr if empty
+    WorldObject* object;
+    // full GUID of occupying object
+    uint64_t guid;
+    // generation of slot, incremented every time the object leaves it
+    uint32_t generation;
+};
+
+/*
+ * Structure of object handle; unlike pointer, it gets safely stale when the object is removed
+ */
+struct ObjectHandle
+{
+    ObjectHandle() : guid(0), generation(0) {};
+    ObjectHandle(uint64_t objGuid, uint32_t slotGeneration) : guid(objGuid), generation(slotGeneration) {};
+
+    // is the handle empty (not referring to any object)?
+    bool IsEmpty() const { return guid == 0; };
+
+    // GUID of object
+    uint64_t guid;
+    // generation of slot at the time the handle was obtained
+    uint32_t generation;
+};
+
 // type of guidmap
 enum GUIDMapType
 {
@@ -46,13 +87,21 @@ class ObjectAccessor
 
         // initializes GUID maps for further use
         void InitGUIDMaps();
+        // stores guidspace snapshot, so the next startup does not have to rebuild it from database
+        void SaveGUIDMapSnapshot();
 
         // adds object to evidence
         void AddObject(uint64_t guid, WorldObject* obj);
         // removes object from evidence
         void RemoveObject(uint64_t guid);
+        // removes object from evidence and schedules its deletion once no thread could refer to it; optionally releases its GUID then
+        void RetireObject(WorldObject* obj, bool releaseGuid = false);
         // finds existing object
         WorldObject* FindWorldObject(uint64_t guid);
+        // finds existing object by handle; returns nullptr if the handle is stale
+        WorldObject* FindWorldObject(ObjectHandle const& handle);
+        // retrieves handle of existing object; returns empty handle if no such object exists
+        ObjectHandle GetObjectHandle(uint64_t guid);
 
         // allocates and builds new creature GUID
         uint64_t AllocateCreatureGUID(uint32_t entry);
@@ -62,16 +111,38 @@ class ObjectAccessor
         uint64_t AllocatePlayerGUID();
         // allocates and builds new item GUID
         uint32_t AllocateItemGUID();
+        // releases allocated creature or gameobject GUID, so it could be assigned again
+        void ReleaseGUID(uint64_t guid);
+        // releases item GUID after the item was deleted from database, so it could be assigned again
+        void ReleaseItemGUID(uint32_t guid);
+
+        // reserves up to count free GUIDs of given type for thread lease; returns count of reserved GUIDs
+        uint32_t LeaseGUIDs(GUIDMapType type, int64_t* guids, uint32_t count);
+        // returns unused GUIDs of thread lease to guidspace
+        void ReturnGUIDs(GUIDMapType type, const int64_t* guids, uint32_t count);
 
     protected:
         // protected singleton constructor
         ObjectAccessor();
 
+        // destroys retired object
+        void DestroyObject(WorldObject* obj);
+        // loads guidspace snapshot if it's still valid; marks loaded guidmaps
+        void LoadGUIDMapSnapshot(bool* loaded);
+        // retrieves row count and maximum GUID of table with GUIDs
+        bool GetGUIDTableState(const char* table, uint64_t& rowCount, uint64_t& maxGuid);
+        // allocates GUID of given type from lease of calling thread, or directly from guidspace if the thread has none
+        int64_t UseGUID(GUIDMapType type);
+        // retrieves slot for given GUID; allocates its page if requested, otherwise returns nullptr when not present
+        ObjectSlot* GetObjectSlot(uint64_t guid, bool create = false);
+
     private:
-        // map of all objects
-        std::unordered_map<uint64_t, WorldObject*> m_objectMap;
+        // pages of object slots for every high GUID type
+        std::vector<ObjectSlot*> m_objectSlotPages[MAX_HIGHGUID];
         // guidspace
         GuidMap m_guidMap[MAX_GUIDMAP];
+        // guidspace lock; threads with bound lease lock it only to reserve another block
+        std::mutex m_guidMapMutex;
 };
 
 #define sObjectAccessor Singleton<ObjectAccessor>::getInstance()
@@ -0,0 +1,278 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "PathfindLayer.h"
+#include "MapStorage.h"
+
+// retrieves page count needed to cover supplied field count
+#define PATHFIND_PAGE_COUNT(fields, pageSize) (((fields) + (pageSize) - 1) / (pageSize))
+// retrieves mask of bits from "from" to "to" (inclusive) within page row
+#define PATHFIND_ROW_MASK(from, to) ((((to) - (from)) == 63 ? ~(uint64_t)0 : (((uint64_t)1 << ((to) - (from) + 1)) - 1)) << (from))
+
+PathfindLayer::PathfindLayer() : m_mapRecord(nullptr), m_pageCountY(0), m_ownedPageCount(0)
+{
+    //
+}
+
+PathfindLayer::~PathfindLayer()
+{
+    ReleaseOwnedPages();
+}
+
+void PathfindLayer::ReleaseOwnedPages()
+{
+    // delete only copied pages, base pages belong to map storage
+    for (PathfindPage* page : m_pages)
+        delete page;
+
+    m_pages.clear();
+    m_ownedPageCount = 0;
+    m_obstacleCounts.clear();
+}
+
+void PathfindLayer::Init(MapRecord* mapRecord)
+{
+    ReleaseOwnedPages();
+
+    m_mapRecord = mapRecord;
+    m_pageCountY = PATHFIND_PAGE_COUNT(mapRecord->header.sizeY, PATHFIND_PAGE_SIZE_Y);
+
+    // start with all pages shared
+    m_pages.assign(mapRecord->chunks.size(), nullptr);
+}
+
+bool PathfindLayer::GetPageIndex(uint32_t x, uint32_t y, uint32_t &pageIndex)
+{
+    if (!m_mapRecord || x >= m_mapRecord->header.sizeX || y >= m_mapRecord->header.sizeY)
+        return false;
+
+    pageIndex = (x / PATHFIND_PAGE_SIZE_X) * m_pageCountY + (y / PATHFIND_PAGE_SIZE_Y);
+
+    return pageIndex < m_pages.size();
+}
+
+PathfindPage* PathfindLayer::GetPage(uint32_t pageIndex)
+{
+    if (m_pages[pageIndex])
+        return m_pages[pageIndex];
+
+    return GetBasePage(pageIndex);
+}
+
+PathfindPage* PathfindLayer::GetBasePage(uint32_t pageIndex)
+{
+    // pages are indexed the same way as chunks
+    return m_mapRecord->chunks[pageIndex].pathfindPage;
+}
+
+PathfindPage* PathfindLayer::GetPageForWrite(uint32_t pageIndex)
+{
+    // the page is still shared with map template - make own copy
+    if (!m_pages[pageIndex])
+    {
+        PathfindPage* basePage = GetBasePage(pageIndex);
+        if (!basePage)
+            return nullptr;
+
+        m_pages[pageIndex] = new PathfindPage(*basePage);
+        m_ownedPageCount++;
+    }
+
+    return m_pages[pageIndex];
+}
+
+bool PathfindLayer::ClampBox(uint32_t &x1, uint32_t &y1, uint32_t &x2, uint32_t &y2)
+{
+    if (!m_mapRecord || m_pages.empty() || x1 > x2 || y1 > y2)
+        return false;
+
+    if (x1 >= m_mapRecord->header.sizeX || y1 >= m_mapRecord->header.sizeY)
+        return false;
+
+    if (x2 >= m_mapRecord->header.sizeX)
+        x2 = m_mapRecord->header.sizeX - 1;
+    if (y2 >= m_mapRecord->header.sizeY)
+        y2 = m_mapRecord->header.sizeY - 1;
+
+    return true;
+}
+
+bool PathfindLayer::IsAccessible(uint32_t x, uint32_t y, uint32_t moveMask)
+{
+    uint32_t pageIndex;
+    if (!GetPageIndex(x, y, pageIndex))
+        return false;
+
+    PathfindPage* page = GetPage(pageIndex);
+    if (!page)
+        return false;
+
+    return IsAccessibleOnPage(page, x, y, moveMask);
+}
+
+bool PathfindLayer::IsAccessibleOnPage(PathfindPage* page, uint32_t x, uint32_t y, uint32_t moveMask)
+{
+    uint64_t bit = (uint64_t)1 << (x % PATHFIND_PAGE_SIZE_X);
+
+    for (uint32_t i = 0; i < MAX_MOVEMENT_TYPE; i++)
+    {
+        if ((moveMask & (1 << i)) != 0 && (page->moveBits[i][y % PATHFIND_PAGE_SIZE_Y] & bit) != 0)
+            return true;
+    }
+
+    return false;
+}
+
+void PathfindLayer::AddObstacle(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2)
+{
+    if (!ClampBox(x1, y1, x2, y2))
+        return;
+
+    uint32_t pageIndex, pageEndX, row, t;
+    uint64_t mask;
+    PathfindPage* page;
+
+    for (uint32_t y = y1; y <= y2; y++)
+    {
+        row = y % PATHFIND_PAGE_SIZE_Y;
+
+        // stamp row by page-wide words
+        for (uint32_t x = x1; x <= x2; x = pageEndX + 1)
+        {
+            pageEndX = num_min(x2, (x / PATHFIND_PAGE_SIZE_X + 1) * PATHFIND_PAGE_SIZE_X - 1);
+
+            GetPageIndex(x, y, pageIndex);
+            page = GetPageForWrite(pageIndex);
+            if (!page)
+                continue;
+
+            for (uint32_t i = x; i <= pageEndX; i++)
+                m_obstacleCounts[y * m_mapRecord->header.sizeX + i]++;
+
+            // turn off all movement here, leave just "NONE" flag if present
+            mask = PATHFIND_ROW_MASK(x % PATHFIND_PAGE_SIZE_X, pageEndX % PATHFIND_PAGE_SIZE_X);
+            for (t = 0; t < MAX_MOVEMENT_TYPE; t++)
+            {
+                if (t != MOVEMENT_TYPE_NONE)
+                    page->moveBits[t][row] &= ~mask;
+            }
+        }
+    }
+}
+
+void PathfindLayer::RemoveObstacle(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2)
+{
+    if (!ClampBox(x1, y1, x2, y2))
+        return;
+
+    uint32_t pageIndex, pageEndX, row, t;
+    uint64_t restoreMask;
+    PathfindPage* page;
+    PathfindPage* basePage;
+    std::unordered_map<uint32_t, uint32_t>::iterator itr;
+
+    for (uint32_t y = y1; y <= y2; y++)
+    {
+        row = y % PATHFIND_PAGE_SIZE_Y;
+
+        for (uint32_t x = x1; x <= x2; x = pageEndX + 1)
+        {
+            pageEndX = num_min(x2, (x / PATHFIND_PAGE_SIZE_X + 1) * PATHFIND_PAGE_SIZE_X - 1);
+
+            // collect fields, that are no longer covered by any obstacle
+            restoreMask = 0;
+            for (uint32_t i = x; i <= pageEndX; i++)
+            {
+                itr = m_obstacleCounts.find(y * m_mapRecord->header.sizeX + i);
+                if (itr == m_obstacleCounts.end())
+                    continue;
+
+                if (--itr->second == 0)
+                {
+                    m_obstacleCounts.erase(itr);
+                    restoreMask |= (uint64_t)1 << (i % PATHFIND_PAGE_SIZE_X);
+                }
+            }
+
+            if (restoreMask == 0)
+                continue;
+
+            // restore original movement mask from base page
+            GetPageIndex(x, y, pageIndex);
+            page = GetPageForWrite(pageIndex);
+            basePage = GetBasePage(pageIndex);
+            if (!page || !basePage)
+                continue;
+
+            for (t = 0; t < MAX_MOVEMENT_TYPE; t++)
+                page->moveBits[t][row] = (page->moveBits[t][row] & ~restoreMask) | (basePage->moveBits[t][row] & restoreMask);
+        }
+    }
+}
+
+uint32_t PathfindLayer::GetOwnedPageCount()
+{
+    return m_ownedPageCount;
+}
+
+PathfindPage* PathfindLayer::BuildBasePage(MapRecord* mapRecord, MapChunkRecord* chunk)
+{
+    PathfindPage* page = new PathfindPage();
+    memset(page->moveBits, 0, sizeof(page->moveBits));
+
+    uint32_t moveMask, t;
+
+    for (uint32_t i = 0; i < PATHFIND_PAGE_SIZE_X; i++)
+    {
+        for (uint32_t j = 0; j < PATHFIND_PAGE_SIZE_Y; j++)
+        {
+            // fields outside map (page padding) are solid
+            if (chunk->startX + i < mapRecord->header.sizeX && chunk->startY + j < mapRecord->header.sizeY)
+                moveMask = GetMovementTypeMaskFor(&chunk->fields[i][j]);
+            else
+                moveMask = (1 << MOVEMENT_TYPE_NONE);
+
+            for (t = 0; t < MAX_MOVEMENT_TYPE; t++)
+            {
+                if ((moveMask & (1 << t)) != 0)
+                    page->moveBits[t][j] |= (uint64_t)1 << i;
+            }
+        }
+    }
+
+    return page;
+}
+
+uint32_t PathfindLayer::GetMovementTypeMaskFor(MapField* fld)
+{
+    uint32_t typeMask = 0;
+
+    if (fld->type == MFT_SOLID)
+        typeMask |= 1 << MOVEMENT_TYPE_NONE;
+    else
+    {
+        if (fld->type == MFT_GROUND)
+            typeMask |= 1 << MOVEMENT_TYPE_WALK;
+        if (fld->type == MFT_WATER || fld->type == MFT_LAVA)
+            typeMask |= 1 << MOVEMENT_TYPE_SWIM;
+    }
+
+    return typeMask;
+}
@@ -0,0 +1,105 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_PATHFIND_LAYER_H
+#define BW_PATHFIND_LAYER_H
+
+#include "MapEnums.h"
+
+// pathfinding page size equals chunk size; one page row has to fit into 64bit word
+#define PATHFIND_PAGE_SIZE_X MAP_CHUNK_SIZE_X
+// pathfinding page size equals chunk size
+#define PATHFIND_PAGE_SIZE_Y MAP_CHUNK_SIZE_Y
+
+/*
+ * Structure containing pathfinding data of one map chunk
+ */
+struct PathfindPage
+{
+    // walkability bitmaps for every movement type (see enum MovementType); one word per row, bit = X offset within page
+    // if "NONE" bit is set, the field is marked solid by map definition
+    uint64_t moveBits[MAX_MOVEMENT_TYPE][PATHFIND_PAGE_SIZE_Y];
+};
+
+typedef std::vector<PathfindPage*> PathfindPageVector;
+
+struct MapRecord;
+struct MapChunkRecord;
+struct MapField;
+
+/*
+ * Class maintaining pathfinding layer of one map instance; pages are shared with map
+ * template stored in MapStorage, and copied only when the map needs to modify them.
+ * Base pages exist only for loaded chunks, the map has to keep them loaded while using the layer
+ */
+class PathfindLayer
+{
+    public:
+        PathfindLayer();
+        ~PathfindLayer();
+
+        // initializes layer to use base pages of supplied map record
+        void Init(MapRecord* mapRecord);
+
+        // is the field accessible using any of movement types in mask? Fields out of bounds or in unloaded chunks are never accessible
+        bool IsAccessible(uint32_t x, uint32_t y, uint32_t moveMask);
+        // adds obstacle covering supplied box (inclusive); fields in unloaded chunks are skipped
+        void AddObstacle(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2);
+        // removes obstacle covering supplied box (inclusive); the box has to match the one used when adding
+        void RemoveObstacle(uint32_t x1, uint32_t y1, uint32_t x2, uint32_t y2);
+        // retrieves count of pages copied by this layer
+        uint32_t GetOwnedPageCount();
+
+        // builds base page of loaded map chunk, shared by all instances
+        static PathfindPage* BuildBasePage(MapRecord* mapRecord, MapChunkRecord* chunk);
+        // retrieves possible movement type for field supplied
+        static uint32_t GetMovementTypeMaskFor(MapField* fld);
+        // is the field on page accessible using any of movement types in mask? Coordinates are absolute
+        static bool IsAccessibleOnPage(PathfindPage* page, uint32_t x, uint32_t y, uint32_t moveMask);
+
+    protected:
+        //
+
+    private:
+        // deletes pages copied by this layer
+        void ReleaseOwnedPages();
+        // retrieves page index of field, or false if the field is out of bounds
+        bool GetPageIndex(uint32_t x, uint32_t y, uint32_t &pageIndex);
+        // retrieves page for reading; nullptr if the chunk is not loaded
+        PathfindPage* GetPage(uint32_t pageIndex);
+        // retrieves base page of map record; nullptr if the chunk is not loaded
+        PathfindPage* GetBasePage(uint32_t pageIndex);
+        // retrieves page for writing; copies the page when still shared, nullptr if the chunk is not loaded
+        PathfindPage* GetPageForWrite(uint32_t pageIndex);
+        // limits box to map boundaries; returns false if the box lies outside the map
+        bool ClampBox(uint32_t &x1, uint32_t &y1, uint32_t &x2, uint32_t &y2);
+
+        // map record the layer is based on
+        MapRecord* m_mapRecord;
+        // page count in Y direction
+        uint32_t m_pageCountY;
+        // pages copied by this layer, nullptr if still shared with base; index = pageX * pageCountY + pageY
+        PathfindPageVector m_pages;
+        // count of owned pages
+        uint32_t m_ownedPageCount;
+        // obstacle count covering field; key = y * mapSizeX + x, only covered fields are present
+        std::unordered_map<uint32_t, uint32_t> m_obstacleCounts;
+};
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "WorldSnapshot.h"
+#include "SmartPacket.h"
+#include "Session.h"
+#include "NetworkManager.h"
+
+WorldSnapshot::WorldSnapshot()
+{
+    //
+}
+
+WorldSnapshot::~WorldSnapshot()
+{
+    //
+}
+
+void WorldSnapshot::Clear()
+{
+    m_records.clear();
+    m_fields.clear();
+    m_packetData.clear();
+    m_recipients.clear();
+    m_sendSlots.clear();
+    m_sendSlotIndexes.clear();
+}
+
+bool WorldSnapshot::IsEmpty()
+{
+    return m_records.empty();
+}
+
+void WorldSnapshot::BeginObject(uint64_t guid)
+{
+    Record rec;
+    rec.type = RECORD_UPDATE;
+    rec.guid = guid;
+    rec.opcode = SP_UPDATE_OBJECT;
+    rec.dataBegin = (uint32_t)(m_fields.size() / 2);
+    rec.dataCount = 0;
+    rec.recipientBegin = (uint32_t)m_recipients.size();
+    rec.recipientCount = 0;
+
+    m_records.push_back(rec);
+}
+
+void WorldSnapshot::AddField(uint32_t index, uint32_t value)
+{
+    m_fields.push_back(index);
+    m_fields.push_back(value);
+    m_records.back().dataCount++;
+}
+
+void WorldSnapshot::AddPacket(SmartPacket &pkt)
+{
+    Record rec;
+    rec.type = RECORD_PACKET;
+    rec.guid = 0;
+    rec.opcode = pkt.GetOpcode();
+    rec.dataBegin = (uint32_t)m_packetData.size();
+    rec.dataCount = pkt.GetSize();
+    rec.recipientBegin = (uint32_t)m_recipients.size();
+    rec.recipientCount = 0;
+
+    m_packetData.insert(m_packetData.end(), pkt.GetData(), pkt.GetData() + pkt.GetSize());
+
+    m_records.push_back(rec);
+}
+
+void WorldSnapshot::AddRecipient(Session* sess)
+{
+    if (!sess)
+        return;
+
+    // the session keeps returning the same place, until some other packet is queued behind it
+    ProcessedPacket* slot = sess->ReserveSendSlot();
+    uint32_t index;
+
+    std::unordered_map<ProcessedPacket*, uint32_t>::iterator itr = m_sendSlotIndexes.find(slot);
+    if (itr == m_sendSlotIndexes.end())
+    {
+        SendSlot target;
+        target.sessionId = sess->GetSessionId();
+        target.slot = slot;
+
+        index = (uint32_t)m_sendSlots.size();
+        m_sendSlots.push_back(target);
+        m_sendSlotIndexes[slot] = index;
+    }
+    else
+        index = itr->second;
+
+    m_recipients.push_back(index);
+    m_records.back().recipientCount++;
+}
+
+void WorldSnapshot::CloseSendSlots()
+{
+    Session* sess;
+
+    for (SendSlot const& target : m_sendSlots)
+    {
+        sess = sNetwork->FindSession(target.sessionId);
+        if (sess)
+            sess->CloseSendSlot(target.slot);
+    }
+}
+
+void WorldSnapshot::AppendPacket(SendSlot &target, uint16_t opcode, uint8_t const* data, uint16_t size)
+{
+    uint16_t op, sz;
+    size_t offset = target.data.size();
+
+    op = htons(opcode);
+    sz = htons(size);
+
+    target.data.resize(offset + SmartPacket::HeaderSize + size);
+
+    // write opcode
+    memcpy(&target.data[offset], &op, 2);
+    // write contents size
+    memcpy(&target.data[offset + 2], &sz, 2);
+    // write contents
+    if (size > 0)
+        memcpy(&target.data[offset + 4], data, size);
+}
+
+void WorldSnapshot::Send()
+{
+    SmartPacket pkt(SP_UPDATE_OBJECT);
+    Session* sess;
+    uint32_t i;
+
+    for (SendSlot& target : m_sendSlots)
+        target.data.clear();
+
+    for (Record const& rec : m_records)
+    {
+        if (rec.recipientCount == 0)
+            continue;
+
+        if (rec.type == RECORD_UPDATE)
+        {
+            if (rec.dataCount == 0)
+                continue;
+
+            pkt.ResetData();
+
+            // write GUID to allow client to identify one specific object
+            pkt.WriteUInt64(rec.guid);
+            pkt.WriteUInt8((uint8_t)rec.dataCount);
+
+            for (i = 0; i < rec.dataCount; i++)
+            {
+                pkt.WriteUInt32(m_fields[(rec.dataBegin + i) * 2]);
+                pkt.WriteUInt32(m_fields[(rec.dataBegin + i) * 2 + 1]);
+            }
+
+            for (i = 0; i < rec.recipientCount; i++)
+                AppendPacket(m_sendSlots[m_recipients[rec.recipientBegin + i]], rec.opcode, pkt.GetData(), pkt.GetSize());
+        }
+        else
+        {
+            for (i = 0; i < rec.recipientCount; i++)
+                AppendPacket(m_sendSlots[m_recipients[rec.recipientBegin + i]], rec.opcode, m_packetData.data() + rec.dataBegin, (uint16_t)rec.dataCount);
+        }
+    }
+
+    // every reserved place has to be filled, even with nothing, otherwise the send queue would be stuck
+    for (SendSlot& target : m_sendSlots)
+    {
+        // the session may have been closed since the capture
+        sess = sNetwork->FindSession(target.sessionId);
+        if (sess)
+            sess->FillSendSlot(target.slot, target.data);
+    }
+}
@@ -0,0 +1,120 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_WORLDSNAPSHOT_H
+#define BW_WORLDSNAPSHOT_H
+
+class SmartPacket;
+class Session;
+struct ProcessedPacket;
+
+/*
+ * Class holding object changes and visibility packets captured during one map update; it does not refer
+ * to any object, so snapshots of all maps could be serialized and sent by other threads while the next
+ * update is running; every recipient session reserves place in its send queue when the first record for it
+ * is captured, so the packets reach the client in the same order as they would be sent during the update
+ */
+class WorldSnapshot
+{
+    public:
+        WorldSnapshot();
+        ~WorldSnapshot();
+
+        // clears captured data; allocated memory is kept for next update
+        void Clear();
+        // is there nothing to be sent?
+        bool IsEmpty();
+
+        // begins capturing changes of object; following fields and recipients belong to it
+        void BeginObject(uint64_t guid);
+        // captures changed update field value
+        void AddField(uint32_t index, uint32_t value);
+        // captures built packet (object creation, destruction); following recipients belong to it
+        void AddPacket(SmartPacket &pkt);
+        // adds session, that should receive last captured record; does nothing for null session
+        void AddRecipient(Session* sess);
+
+        // closes places reserved in send queues, so packets captured since now are not put into them
+        void CloseSendSlots();
+        // builds packets from captured data and fills them into places reserved in send queues of recipients
+        void Send();
+
+    protected:
+        //
+
+    private:
+        // type of captured record
+        enum RecordType
+        {
+            RECORD_UPDATE = 0,
+            RECORD_PACKET = 1
+        };
+
+        /*
+         * Structure of captured record; fields, packet data and recipients are stored in shared arrays
+         */
+        struct Record
+        {
+            // record type
+            RecordType type;
+            // object GUID (update only)
+            uint64_t guid;
+            // packet opcode (packet only)
+            uint16_t opcode;
+            // index of first field (index and value pair), or offset of packet data
+            uint32_t dataBegin;
+            // count of captured fields, or size of packet data
+            uint32_t dataCount;
+            // index of first recipient
+            uint32_t recipientBegin;
+            // count of recipients
+            uint32_t recipientCount;
+        };
+
+        /*
+         * Structure of place reserved in send queue of recipient session
+         */
+        struct SendSlot
+        {
+            // session ID; sessions may disappear before the snapshot is sent
+            uint32_t sessionId;
+            // reserved place in send queue
+            ProcessedPacket* slot;
+            // serialized packets to be filled into reserved place
+            std::vector<uint8_t> data;
+        };
+
+        // appends packet with header to serialized packets of send slot
+        void AppendPacket(SendSlot &target, uint16_t opcode, uint8_t const* data, uint16_t size);
+
+        // captured records
+        std::vector<Record> m_records;
+        // captured fields of all objects; pairs of field index and value
+        std::vector<uint32_t> m_fields;
+        // captured data of all packets
+        std::vector<uint8_t> m_packetData;
+        // recipients of all records (indexes to send slots)
+        std::vector<uint32_t> m_recipients;
+        // places reserved in send queues of recipients
+        std::vector<SendSlot> m_sendSlots;
+        // index of send slot for reserved place
+        std::unordered_map<ProcessedPacket*, uint32_t> m_sendSlotIndexes;
+};
+
+#endif
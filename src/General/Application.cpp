@@ -27,6 +27,7 @@
 #include "Log.h"
 #include "Config.h"
 #include "MapStorage.h"
+#include "ChecksumCache.h"
 #include "MapManager.h"
 #include "CreatureStorage.h"
 #include "GameobjectStorage.h"
@@ -34,12 +35,14 @@
 #include "WaypointStorage.h"
 #include "ItemStorage.h"
 #include "ObjectAccessor.h"
+#include "EpochManager.h"
 
 #include <thread>
 
 Application::Application()
 {
-    //
+    m_utilityMode = false;
+    m_epochSlot = EPOCH_SLOT_NONE;
 }
 
 Application::~Application()
@@ -49,7 +52,8 @@ Application::~Application()
 
 bool Application::Init(int argc, char** argv)
 {
-    // TODO: parse commandline options
+    if (!ParseCommandLine(argc, argv))
+        return false;
 
     sConfig->InitDefaults();
 
@@ -59,6 +63,9 @@ bool Application::Init(int argc, char** argv)
     if (!sConfig->ValidateConfig())
         return false;
 
+    if (m_utilityMode)
+        return RunUtility();
+
     sLog->Info("BubbleWorld game server");
 
     sLog->Info("MySQL Client Library version: %s\n", mysql_get_client_info());
@@ -78,18 +85,25 @@ bool Application::Init(int argc, char** argv)
     sLog->Info(">> Loading resource database...");
     sResourceStorage->LoadFromDB();
     sLog->Info("");
+    sLog->Info(">> Loading checksum cache...");
+    sChecksumCache->Load(sConfig->GetStringValue(CONFIG_STRING_CHECKSUM_CACHE_FILE));
+    sLog->Info("");
     sLog->Info(">> Verifying resource checksums...");
     sResourceStorage->VerifyChecksums();
     sLog->Info("Finished checksum verification");
 
     sLog->Info("");
     sMapStorage->LoadFromDB();
-    sLog->Info(">> Verifying map and map chunk checksums...");
+    sLog->Info(">> Verifying map checksums...");
     sMapStorage->VerifyChecksums();
     sLog->Info("Finished checksum verification");
     sLog->Info("");
 
+    sChecksumCache->Save();
+
     sObjectAccessor->InitGUIDMaps();
+    // objects are created mostly on main thread, let it allocate GUIDs without locking
+    m_guidLease.Bind();
     sLog->Info("");
 
     sCreatureStorage->LoadFromDB();
@@ -106,6 +120,13 @@ bool Application::Init(int argc, char** argv)
 
     sResourceStreamService->Init();
 
+    // main thread holds object pointers during network and map update
+    m_epochSlot = sEpochManager->RegisterThread();
+
+    sLog->Info(">> Starting map loader...");
+    sMapManager->Init();
+    sLog->Info("");
+
     sScriptManager->Initialize();
     sLog->Info("");
 
@@ -121,11 +142,57 @@ bool Application::Init(int argc, char** argv)
     return true;
 }
 
+bool Application::ParseCommandLine(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--convert-map") == 0)
+        {
+            if (i + 2 >= argc)
+            {
+                fprintf(stderr, "Usage: %s --convert-map <source> <destination>\n", argv[0]);
+                return false;
+            }
+
+            m_convertMapSource = argv[++i];
+            m_convertMapDestination = argv[++i];
+            m_utilityMode = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown command line option: %s\n", argv[i]);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Application::RunUtility()
+{
+    if (!m_convertMapSource.empty())
+    {
+        sLog->Info("Converting map file %s to %s", m_convertMapSource.c_str(), m_convertMapDestination.c_str());
+        if (!MapStorage::ConvertMapFile(m_convertMapSource.c_str(), m_convertMapDestination.c_str()))
+        {
+            sLog->Error("Map file conversion failed!");
+            return false;
+        }
+        sLog->Info("Map file conversion finished");
+    }
+
+    return true;
+}
+
 int Application::Run()
 {
     MSG msg;
     bool run = true;
 
+    // utility has already finished during initialization
+    if (m_utilityMode)
+        return 0;
+
     while (run)
     {
         if (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE))
@@ -143,8 +210,21 @@ int Application::Run()
 
         sMapManager->UpdateMaps();
 
+        // no object pointer survives the tick, so objects retired before it could be destroyed
+        sEpochManager->QuiescentPoint(m_epochSlot);
+        sEpochManager->Reclaim();
+
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
     }
 
+    // store checksums of map chunks verified during runtime
+    sChecksumCache->Save();
+
+    // store guidspace, so it does not have to be rebuilt from database on next startup; all threads have to
+    // return their leased GUIDs first, otherwise the unused ones would be stored as used
+    sMapManager->Shutdown();
+    m_guidLease.Release();
+    sObjectAccessor->SaveGUIDMapSnapshot();
+
     return 0;
 }
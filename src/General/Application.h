@@ -21,6 +21,7 @@
 #define BW_APPLICATION_H
 
 #include "Singleton.h"
+#include "GuidLease.h"
 
 /*
  * Class used for maintaining base application routines
@@ -41,7 +42,21 @@ class Application
         Application();
 
     private:
-        //
+        // parses command line options; returns false on invalid options
+        bool ParseCommandLine(int argc, char** argv);
+        // runs utility requested on command line instead of server; returns false on failure
+        bool RunUtility();
+
+        // map file conversion source, if requested on command line
+        std::string m_convertMapSource;
+        // map file conversion destination
+        std::string m_convertMapDestination;
+        // is application running as utility and not as server?
+        bool m_utilityMode;
+        // epoch reclamation slot of main thread
+        uint32_t m_epochSlot;
+        // GUID lease of main thread
+        GuidLease m_guidLease;
 };
 
 #define sApplication Singleton<Application>::getInstance()
@@ -18,10 +18,33 @@
  **/
 
 #include <stdio.h>
+#include <string.h>
 #include "CRC32.h"
 
 #include <iomanip>
 #include <sstream>
+#include <vector>
+
+// use carry-less multiplication (PCLMULQDQ) for longer blocks, when the CPU supports it
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define CRC32_USE_PCLMUL
+#define CRC32_PCLMUL_TARGET
+#include <intrin.h>
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define CRC32_USE_PCLMUL
+#define CRC32_PCLMUL_TARGET __attribute__((target("pclmul,sse4.1")))
+#include <cpuid.h>
+#endif
+
+#ifdef CRC32_USE_PCLMUL
+#include <wmmintrin.h>
+#include <smmintrin.h>
+#endif
+
+// size of buffer used when reading files
+#define CRC32_FILE_BUFFER_SIZE 65536
+// minimal block size processed by PCLMULQDQ folding
+#define CRC32_FOLD_MIN_SIZE 64
 
 static uint32_t crc32_tab[] = {
     0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f,
@@ -69,6 +92,176 @@ static uint32_t crc32_tab[] = {
     0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
 };
 
+/*
+ * Structure holding slicing-by-8 tables and detected CPU features; initialized once at startup
+ */
+static struct CRC32Engine
+{
+    CRC32Engine();
+
+    // slicing tables; table 0 is the standard byte-wise table
+    uint32_t slices[8][256];
+    // is PCLMULQDQ (and SSE4.1) available?
+    bool hasPclmul;
+} crc32_engine;
+
+CRC32Engine::CRC32Engine()
+{
+    uint32_t i, k;
+
+    for (i = 0; i < 256; i++)
+        slices[0][i] = crc32_tab[i];
+
+    for (k = 1; k < 8; k++)
+        for (i = 0; i < 256; i++)
+            slices[k][i] = (slices[k - 1][i] >> 8) ^ slices[0][slices[k - 1][i] & 0xFF];
+
+    hasPclmul = false;
+
+#if defined(CRC32_USE_PCLMUL) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    hasPclmul = (info[2] & (1 << 1)) != 0 && (info[2] & (1 << 19)) != 0;
+#elif defined(CRC32_USE_PCLMUL)
+    unsigned int eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        hasPclmul = (ecx & bit_PCLMUL) != 0 && (ecx & bit_SSE4_1) != 0;
+#endif
+}
+
+// processes bytes using slicing-by-8 tables; works with non-finalized CRC value
+static uint32_t CRC32_Slice8(const uint8_t* data, size_t count, uint32_t crc)
+{
+    uint32_t (*t)[256] = crc32_engine.slices;
+    uint32_t one, two;
+
+    // process 8 bytes at once; the data are little endian
+    while (count >= 8)
+    {
+        memcpy(&one, data, sizeof(uint32_t));
+        memcpy(&two, data + 4, sizeof(uint32_t));
+        one ^= crc;
+
+        crc = t[7][one & 0xFF] ^ t[6][(one >> 8) & 0xFF] ^ t[5][(one >> 16) & 0xFF] ^ t[4][one >> 24]
+            ^ t[3][two & 0xFF] ^ t[2][(two >> 8) & 0xFF] ^ t[1][(two >> 16) & 0xFF] ^ t[0][two >> 24];
+
+        data += 8;
+        count -= 8;
+    }
+
+    while (count-- > 0)
+        crc = t[0][(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+
+    return crc;
+}
+
+#ifdef CRC32_USE_PCLMUL
+
+// folding constants for reflected CRC32 polynomial
+alignas(16) static const uint64_t crc32_k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+alignas(16) static const uint64_t crc32_k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+alignas(16) static const uint64_t crc32_k5k0[] = { 0x0163cd6124, 0x0000000000 };
+alignas(16) static const uint64_t crc32_poly[] = { 0x01db710641, 0x01f7011641 };
+
+// processes blocks of 16 bytes using carry-less multiplication folding; count has to be at least 64 and multiple of 16
+CRC32_PCLMUL_TARGET static uint32_t CRC32_Fold(const uint8_t* data, size_t count, uint32_t crc)
+{
+    __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+    x1 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+    x2 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+    x3 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+    x4 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+
+    x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)crc));
+
+    x0 = _mm_load_si128((const __m128i*)crc32_k1k2);
+
+    data += 64;
+    count -= 64;
+
+    // fold by 4 blocks in parallel
+    while (count >= 64)
+    {
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+        x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+        x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+        x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+        x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+
+        y5 = _mm_loadu_si128((const __m128i*)(data + 0x00));
+        y6 = _mm_loadu_si128((const __m128i*)(data + 0x10));
+        y7 = _mm_loadu_si128((const __m128i*)(data + 0x20));
+        y8 = _mm_loadu_si128((const __m128i*)(data + 0x30));
+
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+        x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+        x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+        x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+
+        data += 64;
+        count -= 64;
+    }
+
+    // fold 4 blocks into one
+    x0 = _mm_load_si128((const __m128i*)crc32_k3k4);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+    x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+    // fold remaining single blocks
+    while (count >= 16)
+    {
+        x2 = _mm_loadu_si128((const __m128i*)data);
+
+        x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        data += 16;
+        count -= 16;
+    }
+
+    // fold 128 bits to 64 bits
+    x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+    x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+    x1 = _mm_srli_si128(x1, 8);
+    x1 = _mm_xor_si128(x1, x2);
+
+    x0 = _mm_loadl_epi64((const __m128i*)crc32_k5k0);
+
+    x2 = _mm_srli_si128(x1, 4);
+    x1 = _mm_and_si128(x1, x3);
+    x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    // Barrett reduction to 32 bits
+    x0 = _mm_load_si128((const __m128i*)crc32_poly);
+
+    x2 = _mm_and_si128(x1, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+    x2 = _mm_and_si128(x2, x3);
+    x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+    x1 = _mm_xor_si128(x1, x2);
+
+    return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+#endif
+
 std::string GetCRC32String(uint32_t crc)
 {
     std::stringstream stream;
@@ -79,10 +272,18 @@ std::string GetCRC32String(uint32_t crc)
 
 uint32_t CRC32_Bytes_Continuous(uint8_t* data, uint32_t count, uint32_t crc)
 {
-    for (uint32_t i = 0; i < count; i++)
-        crc = crc32_tab[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+#ifdef CRC32_USE_PCLMUL
+    // fold the longest part divisible by block size, and process the rest using tables
+    if (crc32_engine.hasPclmul && count >= CRC32_FOLD_MIN_SIZE)
+    {
+        uint32_t folded = count & ~15U;
+        crc = CRC32_Fold(data, folded, crc);
+        data += folded;
+        count -= folded;
+    }
+#endif
 
-    return crc;
+    return CRC32_Slice8(data, count, crc);
 }
 
 uint32_t CRC32_Bytes_ContinuousFinalize(uint32_t crc)
@@ -92,21 +293,18 @@ uint32_t CRC32_Bytes_ContinuousFinalize(uint32_t crc)
 
 uint32_t CRC32_Bytes(uint8_t* data, uint32_t count)
 {
-    uint32_t crc;
-
-    for (uint32_t i = 0; i < count; i++)
-        crc = crc32_tab[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
-
-    return crc ^ ~0U;
+    return CRC32_Bytes_ContinuousFinalize(CRC32_Bytes_Continuous(data, count, 0));
 }
 
 uint32_t CRC32_File(FILE* f)
 {
-    uint32_t crc;
-    uint8_t rbyte;
+    uint32_t crc = 0;
+    size_t count;
 
-    while (fread(&rbyte, 1, 1, f) == 1)
-        crc = crc32_tab[(crc ^ rbyte) & 0xFF] ^ (crc >> 8);
+    std::vector<uint8_t> buffer(CRC32_FILE_BUFFER_SIZE);
 
-    return crc ^ ~0U;
+    while ((count = fread(buffer.data(), 1, buffer.size(), f)) > 0)
+        crc = CRC32_Bytes_Continuous(buffer.data(), (uint32_t)count, crc);
+
+    return CRC32_Bytes_ContinuousFinalize(crc);
 }
@@ -23,6 +23,13 @@
 #define num_min(a,b) (a<b?a:b)
 #define num_max(a,b) (a>b?a:b)
 
+// thread local storage specifier; older MSVC supports only its own specifier, usable for POD types
+#if defined(_MSC_VER) && _MSC_VER < 1900
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL thread_local
+#endif
+
 // retrieves time in milliseconds; used for comparisons with another number retrieved this way,
 // not for timing by real time!
 #ifdef _WIN32
@@ -47,6 +54,58 @@ inline unsigned int getMSTimeDiff(unsigned int oldMSTime, unsigned int newMSTime
         return newMSTime - oldMSTime;
 }
 
+// size of CPU cache line
+#define CACHELINE_SIZE 64
+
+// aligns variable or member to cache line
+#ifdef _MSC_VER
+#define CACHELINE_ALIGNED __declspec(align(64))
+#else
+#define CACHELINE_ALIGNED alignas(CACHELINE_SIZE)
+#endif
+
+// allocates memory aligned to given boundary (power of two); returns nullptr on failure
+inline void* custom_alignedAlloc(size_t size, size_t alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    void* ptr;
+    if (posix_memalign(&ptr, alignment, size) != 0)
+        return nullptr;
+    return ptr;
+#endif
+}
+
+// frees memory allocated by custom_alignedAlloc
+inline void custom_alignedFree(void* ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+#ifdef _WIN32
+#include <intrin.h>
+#endif
+
+// retrieves index of the lowest set bit (count of trailing zeros); value must not be zero
+inline uint32_t custom_ctz64(uint64_t value)
+{
+#ifdef _WIN32
+    unsigned long index;
+    // 32bit scans are available on both x86 and x64 targets
+    if (_BitScanForward(&index, (unsigned long)(value & 0xFFFFFFFF)))
+        return (uint32_t)index;
+    _BitScanForward(&index, (unsigned long)(value >> 32));
+    return (uint32_t)index + 32;
+#else
+    return (uint32_t)__builtin_ctzll(value);
+#endif
+}
+
 // creates directory
 inline bool custom_createDirectory(const char* path)
 {
@@ -60,6 +119,26 @@ inline bool custom_createDirectory(const char* path)
         return false;
 }
 
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// retrieves file size and last modification time; returns false if the file does not exist
+inline bool custom_getFileInfo(const char* path, uint64_t& size, uint64_t& modifyTime)
+{
+#ifdef _WIN32
+    struct _stat64 st;
+    if (_stat64(path, &st) != 0)
+#else
+    struct stat st;
+    if (stat(path, &st) != 0)
+#endif
+        return false;
+
+    size = (uint64_t)st.st_size;
+    modifyTime = (uint64_t)st.st_mtime;
+    return true;
+}
+
 inline std::wstring UTF8ToWString(const std::string& str)
 {
     try
@@ -57,6 +57,20 @@ void ConfigMgr::InitDefaults()
     // network settings
     SetConfigStringField(CONFIG_STRING_BIND_IP, "listen_ip", "127.0.0.1");
     SetConfigIntField(CONFIG_INT_BIND_PORT, "listen_port", 7874);
+
+    // checksum settings
+    SetConfigStringField(CONFIG_STRING_CHECKSUM_CACHE_FILE, "checksum_cache_file", "checksum.cache");
+
+    // guidspace settings
+    SetConfigStringField(CONFIG_STRING_GUIDMAP_SNAPSHOT_FILE, "guidmap_snapshot_file", "guidmap.snapshot");
+
+    // world settings
+    SetConfigIntField(CONFIG_INT_MAP_VISIBILITY_DISTANCE, "visibility_distance", 40);
+    SetConfigStringField(CONFIG_STRING_MAP_VISIBILITY_DISTANCE_OVERRIDES, "visibility_distance_maps", "");
+    SetConfigStringField(CONFIG_STRING_MAP_PREWARM, "map_prewarm", "");
+    SetConfigIntField(CONFIG_INT_MAP_UNLOAD_IDLE_TIME, "map_unload_idle_time", 10);
+    SetConfigIntField(CONFIG_INT_MAP_CHUNK_UNLOAD_DELAY, "map_chunk_unload_delay", 60);
+    SetConfigIntField(CONFIG_INT_MAP_CELL_DESPAWN_TIME, "map_cell_despawn_time", 0);
 }
 
 bool ConfigMgr::ValidateConfig()
@@ -78,6 +92,34 @@ bool ConfigMgr::ValidateConfig()
         errorCount++;
     }
 
+    // validate visibility distance
+    if (GetIntValue(CONFIG_INT_MAP_VISIBILITY_DISTANCE) <= 0)
+    {
+        std::cerr << "Config error: visibility distance must be positive" << std::endl;
+        errorCount++;
+    }
+
+    // validate map unload time
+    if (GetIntValue(CONFIG_INT_MAP_UNLOAD_IDLE_TIME) < 0)
+    {
+        std::cerr << "Config error: map unload idle time must not be negative" << std::endl;
+        errorCount++;
+    }
+
+    // validate map chunk unload delay
+    if (GetIntValue(CONFIG_INT_MAP_CHUNK_UNLOAD_DELAY) < 0)
+    {
+        std::cerr << "Config error: map chunk unload delay must not be negative" << std::endl;
+        errorCount++;
+    }
+
+    // validate map cell despawn time
+    if (GetIntValue(CONFIG_INT_MAP_CELL_DESPAWN_TIME) < 0)
+    {
+        std::cerr << "Config error: map cell despawn time must not be negative" << std::endl;
+        errorCount++;
+    }
+
     // look for uninitialized config values and report them
     for (i = 0; i < CONFIG_MAX_INT_VAL; i++)
     {
@@ -142,8 +184,8 @@ void ConfigMgr::ProcessConfigLine(std::string &line)
 
     // find '=' to be able to find left side (identifier) and right side (value)
     size_t eq = line.find_first_of('=');
-    // not found or at the end of the line
-    if (eq == std::string::npos || eq == line.size() - 1)
+    // not found or without identifier; empty value is allowed, some string values use it to disable the feature
+    if (eq == std::string::npos || eq == 0)
     {
         std::cerr << "Invalid config line: " << line.c_str() << std::endl;
         return;
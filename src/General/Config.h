@@ -31,6 +31,10 @@ enum ConfigIntValues
     CONFIG_INT_DB_PORT = 0,
     CONFIG_INT_LOG_MASK = 1,
     CONFIG_INT_BIND_PORT = 2,
+    CONFIG_INT_MAP_VISIBILITY_DISTANCE = 3,
+    CONFIG_INT_MAP_UNLOAD_IDLE_TIME = 4,
+    CONFIG_INT_MAP_CHUNK_UNLOAD_DELAY = 5,
+    CONFIG_INT_MAP_CELL_DESPAWN_TIME = 6,
     CONFIG_MAX_INT_VAL
 };
 
@@ -43,6 +47,10 @@ enum ConfigStringValues
     CONFIG_STRING_DB_DBNAME = 3,
     CONFIG_STRING_LOG_FILE = 4,
     CONFIG_STRING_BIND_IP = 5,
+    CONFIG_STRING_MAP_VISIBILITY_DISTANCE_OVERRIDES = 6,
+    CONFIG_STRING_MAP_PREWARM = 7,
+    CONFIG_STRING_CHECKSUM_CACHE_FILE = 8,
+    CONFIG_STRING_GUIDMAP_SNAPSHOT_FILE = 9,
     CONFIG_MAX_STRING_VAL
 };
 
@@ -0,0 +1,111 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "EpochManager.h"
+
+EpochManager::EpochManager()
+{
+    m_globalEpoch.store(1);
+
+    for (uint32_t i = 0; i < EPOCH_MAX_THREADS; i++)
+        m_threadEpochs[i].store(EPOCH_INACTIVE);
+}
+
+EpochManager::~EpochManager()
+{
+    // nobody could reach anything at this time
+    for (EpochRetiredRecord& rec : m_retired)
+        rec.deleter();
+}
+
+uint32_t EpochManager::RegisterThread()
+{
+    std::unique_lock<std::mutex> lck(m_slotMutex);
+
+    for (uint32_t i = 0; i < EPOCH_MAX_THREADS; i++)
+    {
+        if (m_threadEpochs[i].load() == EPOCH_INACTIVE)
+        {
+            m_threadEpochs[i].store(m_globalEpoch.load());
+            return i;
+        }
+    }
+
+    return EPOCH_SLOT_NONE;
+}
+
+void EpochManager::UnregisterThread(uint32_t slot)
+{
+    if (slot >= EPOCH_MAX_THREADS)
+        return;
+
+    std::unique_lock<std::mutex> lck(m_slotMutex);
+
+    m_threadEpochs[slot].store(EPOCH_INACTIVE);
+}
+
+void EpochManager::QuiescentPoint(uint32_t slot)
+{
+    if (slot >= EPOCH_MAX_THREADS)
+        return;
+
+    m_threadEpochs[slot].store(m_globalEpoch.load());
+}
+
+void EpochManager::Retire(EpochDeleter const& deleter)
+{
+    std::unique_lock<std::mutex> lck(m_retiredMutex);
+
+    m_retired.push_back(EpochRetiredRecord(m_globalEpoch.load(), deleter));
+}
+
+void EpochManager::Reclaim()
+{
+    uint32_t i;
+    uint64_t epoch, minEpoch;
+
+    // resources retired since now belong to new epoch
+    minEpoch = m_globalEpoch.fetch_add(1) + 1;
+
+    // find the oldest epoch observed by any participant
+    for (i = 0; i < EPOCH_MAX_THREADS; i++)
+    {
+        epoch = m_threadEpochs[i].load();
+        if (epoch < minEpoch)
+            minEpoch = epoch;
+    }
+
+    std::list<EpochRetiredRecord> reclaimed;
+
+    // resources retired before every participant passed quiescent point are unreachable
+    {
+        std::unique_lock<std::mutex> lck(m_retiredMutex);
+
+        std::list<EpochRetiredRecord>::iterator itr = m_retired.begin();
+        while (itr != m_retired.end() && itr->epoch < minEpoch)
+            ++itr;
+
+        reclaimed.splice(reclaimed.begin(), m_retired, m_retired.begin(), itr);
+    }
+
+    // deleters may retire another resources, so call them without lock
+    for (EpochRetiredRecord& rec : reclaimed)
+        rec.deleter();
+}
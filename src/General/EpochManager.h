@@ -0,0 +1,92 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_EPOCHMANAGER_H
+#define BW_EPOCHMANAGER_H
+
+#include "Singleton.h"
+
+#include <atomic>
+#include <functional>
+
+// maximum count of participating threads
+#define EPOCH_MAX_THREADS 64
+// epoch value of unused thread slot
+#define EPOCH_INACTIVE 0xFFFFFFFFFFFFFFFFULL
+// thread slot value returned when no slot is available
+#define EPOCH_SLOT_NONE 0xFFFFFFFF
+
+// function freeing retired resource
+typedef std::function<void()> EpochDeleter;
+
+/*
+ * Structure of retired resource waiting for deletion
+ */
+struct EpochRetiredRecord
+{
+    EpochRetiredRecord(uint64_t _epoch, EpochDeleter const& _deleter) : epoch(_epoch), deleter(_deleter) {};
+
+    // global epoch at the time of retiring
+    uint64_t epoch;
+    // function freeing resource
+    EpochDeleter deleter;
+};
+
+/*
+ * Singleton class maintaining epoch-based deferred deletion; retired resources are freed
+ * once every participating thread passed a quiescent point (holds no pointer obtained before retiring)
+ */
+class EpochManager
+{
+    friend class Singleton<EpochManager>;
+    public:
+        ~EpochManager();
+
+        // registers calling thread as participant; returns its slot, or EPOCH_SLOT_NONE if there's no free slot
+        uint32_t RegisterThread();
+        // unregisters participant thread
+        void UnregisterThread(uint32_t slot);
+        // announces, that participant thread holds no pointers to resources retired so far
+        void QuiescentPoint(uint32_t slot);
+
+        // schedules deleter to be called once no participant could reach the resource
+        void Retire(EpochDeleter const& deleter);
+        // advances global epoch and calls deleters of resources no longer reachable
+        void Reclaim();
+
+    protected:
+        // protected singleton constructor
+        EpochManager();
+
+    private:
+        // global epoch
+        std::atomic<uint64_t> m_globalEpoch;
+        // epoch observed by participant at its last quiescent point; EPOCH_INACTIVE for unused slot
+        std::atomic<uint64_t> m_threadEpochs[EPOCH_MAX_THREADS];
+        // lock for thread slot allocation
+        std::mutex m_slotMutex;
+        // retired resources, ordered by epoch
+        std::list<EpochRetiredRecord> m_retired;
+        // lock for retired resource list
+        std::mutex m_retiredMutex;
+};
+
+#define sEpochManager Singleton<EpochManager>::getInstance()
+
+#endif
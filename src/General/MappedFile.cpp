@@ -0,0 +1,136 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "MappedFile.h"
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0)
+{
+#ifdef _WIN32
+    m_fileHandle = INVALID_HANDLE_VALUE;
+    m_mappingHandle = NULL;
+#else
+    m_fd = -1;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+    Close();
+
+#ifdef _WIN32
+    m_fileHandle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (m_fileHandle == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(m_fileHandle, &fileSize) || fileSize.QuadPart == 0)
+    {
+        Close();
+        return false;
+    }
+
+    m_size = (size_t)fileSize.QuadPart;
+
+    m_mappingHandle = CreateFileMappingA(m_fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (m_mappingHandle == NULL)
+    {
+        Close();
+        return false;
+    }
+
+    m_data = (uint8_t*)MapViewOfFile(m_mappingHandle, FILE_MAP_READ, 0, 0, 0);
+#else
+    m_fd = open(path, O_RDONLY);
+    if (m_fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(m_fd, &st) != 0 || st.st_size == 0)
+    {
+        Close();
+        return false;
+    }
+
+    m_size = (size_t)st.st_size;
+
+    void* data = mmap(nullptr, m_size, PROT_READ, MAP_SHARED, m_fd, 0);
+    m_data = (data == MAP_FAILED) ? nullptr : (uint8_t*)data;
+#endif
+
+    if (!m_data)
+    {
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mappingHandle != NULL)
+        CloseHandle(m_mappingHandle);
+    if (m_fileHandle != INVALID_HANDLE_VALUE)
+        CloseHandle(m_fileHandle);
+
+    m_fileHandle = INVALID_HANDLE_VALUE;
+    m_mappingHandle = NULL;
+#else
+    if (m_data)
+        munmap(m_data, m_size);
+    if (m_fd >= 0)
+        close(m_fd);
+
+    m_fd = -1;
+#endif
+
+    m_data = nullptr;
+    m_size = 0;
+}
+
+bool MappedFile::IsOpen()
+{
+    return m_data != nullptr;
+}
+
+uint8_t* MappedFile::GetData()
+{
+    return m_data;
+}
+
+size_t MappedFile::GetSize()
+{
+    return m_size;
+}
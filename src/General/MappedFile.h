@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_MAPPEDFILE_H
+#define BW_MAPPEDFILE_H
+
+/*
+ * Class maintaining read-only memory mapping of file
+ */
+class MappedFile
+{
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        // maps whole file to memory; returns true on success
+        bool Open(const char* path);
+        // unmaps file from memory
+        void Close();
+
+        // is the file mapped?
+        bool IsOpen();
+        // retrieves pointer to mapped file contents
+        uint8_t* GetData();
+        // retrieves size of mapped file
+        size_t GetSize();
+
+    protected:
+        //
+
+    private:
+        // mapped file contents
+        uint8_t* m_data;
+        // mapped file size
+        size_t m_size;
+
+#ifdef _WIN32
+        // file handle
+        HANDLE m_fileHandle;
+        // file mapping handle
+        HANDLE m_mappingHandle;
+#else
+        // file descriptor
+        int m_fd;
+#endif
+};
+
+#endif
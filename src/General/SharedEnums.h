@@ -85,6 +85,7 @@ enum MovementType
     MOVEMENT_TYPE_NONE = 0,
     MOVEMENT_TYPE_WALK = 1,
     MOVEMENT_TYPE_SWIM = 2,
+    MAX_MOVEMENT_TYPE
 };
 
 // item inventory operation
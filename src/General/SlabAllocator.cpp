@@ -0,0 +1,102 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "SlabAllocator.h"
+#include "Log.h"
+
+SlabAllocator::SlabAllocator(size_t elementSize, uint32_t elementCount)
+{
+    // every element starts at cache line boundary
+    m_elementSize = ((elementSize + CACHELINE_SIZE - 1) / CACHELINE_SIZE) * CACHELINE_SIZE;
+    m_elementCount = elementCount;
+    m_freeList = nullptr;
+}
+
+SlabAllocator::~SlabAllocator()
+{
+    for (void* slab : m_slabs)
+        custom_alignedFree(slab);
+}
+
+void* SlabAllocator::Allocate(size_t size)
+{
+    if (size > m_elementSize)
+    {
+        sLog->Error("Attempted to allocate %u bytes from slab allocator of %u bytes elements", (uint32_t)size, (uint32_t)m_elementSize);
+        return nullptr;
+    }
+
+    std::unique_lock<std::mutex> lck(m_mutex);
+
+    if (!m_freeList && !AddSlab())
+        return nullptr;
+
+    FreeElement* element = m_freeList;
+    m_freeList = element->next;
+
+    return element;
+}
+
+void SlabAllocator::Free(void* ptr)
+{
+    if (!ptr)
+        return;
+
+    std::unique_lock<std::mutex> lck(m_mutex);
+
+#ifdef _DEBUG
+    // keep the element poisoned for a while, so dangling pointers fail deterministically
+    memset(ptr, SLAB_POISON_BYTE, m_elementSize);
+
+    m_quarantine.push(ptr);
+    if (m_quarantine.size() <= SLAB_QUARANTINE_SIZE)
+        return;
+
+    ptr = m_quarantine.front();
+    m_quarantine.pop();
+#endif
+
+    FreeElement* element = (FreeElement*)ptr;
+    element->next = m_freeList;
+    m_freeList = element;
+}
+
+bool SlabAllocator::AddSlab()
+{
+    uint8_t* slab = (uint8_t*)custom_alignedAlloc(m_elementSize * m_elementCount, CACHELINE_SIZE);
+    if (!slab)
+    {
+        sLog->Error("Could not allocate slab of %u elements of %u bytes", m_elementCount, (uint32_t)m_elementSize);
+        return false;
+    }
+
+    m_slabs.push_back(slab);
+
+    // chain elements in ascending order, so consecutive allocations are adjacent in memory
+    FreeElement* element;
+    for (uint32_t i = m_elementCount; i > 0; i--)
+    {
+        element = (FreeElement*)(slab + (i - 1) * m_elementSize);
+        element->next = m_freeList;
+        m_freeList = element;
+    }
+
+    return true;
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_SLABALLOCATOR_H
+#define BW_SLABALLOCATOR_H
+
+// default count of elements in one slab
+#define SLAB_DEFAULT_ELEMENT_COUNT 256
+// byte used to overwrite freed elements in debug build
+#define SLAB_POISON_BYTE 0xDD
+// count of freed elements kept poisoned before they could be allocated again (debug build only)
+#define SLAB_QUARANTINE_SIZE 1024
+
+/*
+ * Allocator of fixed size elements; elements are allocated in cache line aligned slabs, so
+ * objects of the same type are kept close to each other instead of being scattered across heap
+ */
+class SlabAllocator
+{
+    public:
+        SlabAllocator(size_t elementSize, uint32_t elementCount = SLAB_DEFAULT_ELEMENT_COUNT);
+        ~SlabAllocator();
+
+        // allocates element of at most element size; returns nullptr on failure
+        void* Allocate(size_t size);
+        // returns element to allocator
+        void Free(void* ptr);
+
+    protected:
+        // allocates another slab and puts its elements to free list
+        bool AddSlab();
+
+    private:
+        /*
+         * Structure of free element; stored in the element memory itself
+         */
+        struct FreeElement
+        {
+            // next free element
+            FreeElement* next;
+        };
+
+        // size of one element, rounded up to cache line size
+        size_t m_elementSize;
+        // count of elements in one slab
+        uint32_t m_elementCount;
+        // allocated slabs
+        std::vector<void*> m_slabs;
+        // first free element
+        FreeElement* m_freeList;
+        // allocator lock
+        std::mutex m_mutex;
+
+#ifdef _DEBUG
+        // freed elements kept poisoned to catch dangling pointers
+        std::queue<void*> m_quarantine;
+#endif
+};
+
+#endif
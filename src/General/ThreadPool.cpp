@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "ThreadPool.h"
+#include "GuidLease.h"
+
+ThreadPool::ThreadPool(uint32_t threadCount)
+{
+    m_unfinishedTasks = 0;
+    m_running = true;
+
+    if (threadCount == 0)
+        threadCount = std::thread::hardware_concurrency();
+    // hardware_concurrency may not be able to determine thread count
+    if (threadCount == 0)
+        threadCount = 1;
+
+    for (uint32_t i = 0; i < threadCount; i++)
+        m_workers.push_back(std::thread(&ThreadPool::WorkerRun, this));
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_taskMutex);
+        m_running = false;
+    }
+    m_taskCond.notify_all();
+
+    for (std::thread& worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::Enqueue(std::function<void()> task)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_taskMutex);
+        m_tasks.push(task);
+        m_unfinishedTasks++;
+    }
+    m_taskCond.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(m_taskMutex);
+
+    while (m_unfinishedTasks > 0)
+        m_finishCond.wait(lock);
+}
+
+uint32_t ThreadPool::GetThreadCount()
+{
+    return (uint32_t)m_workers.size();
+}
+
+void ThreadPool::WorkerRun()
+{
+    std::function<void()> task;
+
+    // tasks creating objects take GUIDs from worker's own lease; unused GUIDs are returned when the worker exits
+    GuidLease guidLease;
+    guidLease.Bind();
+
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(m_taskMutex);
+
+            while (m_running && m_tasks.empty())
+                m_taskCond.wait(lock);
+
+            // finish remaining tasks even when shutting down
+            if (m_tasks.empty())
+                return;
+
+            task = m_tasks.front();
+            m_tasks.pop();
+        }
+
+        task();
+
+        {
+            std::unique_lock<std::mutex> lock(m_taskMutex);
+            m_unfinishedTasks--;
+            if (m_unfinishedTasks == 0)
+                m_finishCond.notify_all();
+        }
+    }
+}
@@ -0,0 +1,64 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_THREADPOOL_H
+#define BW_THREADPOOL_H
+
+#include <functional>
+
+/*
+ * Class maintaining pool of worker threads executing queued tasks
+ */
+class ThreadPool
+{
+    public:
+        // creates pool with given number of workers; 0 means number of hardware threads
+        ThreadPool(uint32_t threadCount = 0);
+        ~ThreadPool();
+
+        // enqueues task for execution in one of worker threads
+        void Enqueue(std::function<void()> task);
+        // waits until all enqueued tasks are finished
+        void Wait();
+
+        // retrieves number of worker threads
+        uint32_t GetThreadCount();
+
+    protected:
+        // worker thread main function
+        void WorkerRun();
+
+    private:
+        // worker threads
+        std::vector<std::thread> m_workers;
+        // tasks waiting for execution
+        std::queue<std::function<void()>> m_tasks;
+        // count of tasks enqueued and not yet finished
+        uint32_t m_unfinishedTasks;
+        // is the pool still running?
+        bool m_running;
+        // lock for task queue
+        std::mutex m_taskMutex;
+        // condition variable for waking workers
+        std::condition_variable m_taskCond;
+        // condition variable for notifying about finished tasks
+        std::condition_variable m_finishCond;
+};
+
+#endif
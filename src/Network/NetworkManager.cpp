@@ -408,6 +408,17 @@ bool NetworkManager::SendPacketToSession(SmartPacket &pkt, uint32_t sessionId)
     return true;
 }
 
+Session* NetworkManager::FindSession(uint32_t sessionId)
+{
+    std::unique_lock<std::mutex> lck(m_netMutex);
+
+    std::map<uint32_t, Session*>::iterator itr = m_sessionsBySessionId.find(sessionId);
+    if (itr == m_sessionsBySessionId.end())
+        return nullptr;
+
+    return itr->second;
+}
+
 uint32_t NetworkManager::GenerateSessionId()
 {
     // TODO: rework to more long-term stuff (hole-filling, etc.)
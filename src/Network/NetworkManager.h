@@ -98,6 +98,8 @@ class NetworkManager
         bool SendPacket(int len, uint8_t* data, SOCK targetSocket);
         // send packet to session
         bool SendPacketToSession(SmartPacket &pkt, uint32_t sessionId);
+        // finds session by its ID; returns nullptr if the session no longer exists
+        Session* FindSession(uint32_t sessionId);
 
     protected:
         // protected singleton constructor
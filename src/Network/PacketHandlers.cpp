@@ -28,6 +28,7 @@
 #include "ItemStorage.h"
 #include "Player.h"
 #include "Creature.h"
+#include "Map.h"
 #include "MapManager.h"
 #include "MapStorage.h"
 #include "Log.h"
@@ -168,19 +169,17 @@ void PacketHandlers::HandleEnterWorld(Session* sess, SmartPacket& packet)
 
 void PacketHandlers::HandleEnterWorldComplete(Session* sess, SmartPacket& packet)
 {
-    // entering world complete, now it's safe to consider player "ingame"
-    sess->SetConnectionState(CONNECTION_STATE_INGAME);
+    Player* plr = sess->GetPlayer();
 
-    // get player's map
-    Map* map = sMapManager->GetMap(sess->GetPlayer()->GetMapId());
-    if (!map)
+    if (!sMapManager->CanEnterMap(plr->GetMapId(), plr->GetInstanceId()))
     {
-        sLog->Error("Could not retrieve map ID %u, that should be already loaded!", sess->GetPlayer()->GetMapId());
+        sLog->Error("Could not retrieve map ID %u for player %s!", plr->GetMapId(), plr->GetName());
         return;
     }
 
-    // add player object to map
-    map->AddToMap(sess->GetPlayer());
+    // add player object to map; if the map is still being created, the player stays in loading state until it's ready
+    // and then it's safe to consider player "ingame"
+    sMapManager->AddPlayerToMap(plr);
 }
 
 void PacketHandlers::HandleGetMapMetadata(Session* sess, SmartPacket& packet)
@@ -226,10 +225,9 @@ void PacketHandlers::HandleGetMapChunk(Session* sess, SmartPacket& packet)
     uint32_t chunkIndexX = MapStorage::GetChunkIndexX(startX);
     uint32_t chunkIndexY = MapStorage::GetChunkIndexY(startY);
 
-    // get map record
+    // get map record; the map itself does not need to be created
     MapRecord* mrec = sMapStorage->GetMapRecord(mapId);
-    Map* map = sMapManager->GetMap(mapId);
-    if (!mrec || !map)
+    if (!mrec)
     {
         SmartPacket pkt(SP_MAP_CHUNK);
         pkt.WriteUInt8(GENERIC_STATUS_NOTFOUND);
@@ -237,8 +235,9 @@ void PacketHandlers::HandleGetMapChunk(Session* sess, SmartPacket& packet)
         return;
     }
 
-    // limit chunk coordinates
-    if (chunkIndexX >= mrec->chunks.size() || chunkIndexY >= mrec->chunks[chunkIndexX].size())
+    // limit chunk coordinates; the chunk is loaded if needed
+    MapChunkRecord* chunk = sMapStorage->AcquireChunk(mrec, chunkIndexX, chunkIndexY);
+    if (!chunk)
     {
         SmartPacket pkt(SP_MAP_CHUNK);
         pkt.WriteUInt8(GENERIC_STATUS_ERROR);
@@ -249,26 +248,26 @@ void PacketHandlers::HandleGetMapChunk(Session* sess, SmartPacket& packet)
     SmartPacket pkt(SP_MAP_CHUNK);
     pkt.WriteUInt8(GENERIC_STATUS_OK);
 
-    MapChunkRecord &chunk = mrec->chunks[chunkIndexX][chunkIndexY];
-
     // chunk metadata
-    pkt.WriteUInt32(chunk.mapId);
-    pkt.WriteUInt32(chunk.startX);
-    pkt.WriteUInt32(chunk.startY);
-    pkt.WriteUInt32(chunk.sizeX);
-    pkt.WriteUInt32(chunk.sizeY);
+    pkt.WriteUInt32(chunk->mapId);
+    pkt.WriteUInt32(chunk->startX);
+    pkt.WriteUInt32(chunk->startY);
+    pkt.WriteUInt32(chunk->sizeX);
+    pkt.WriteUInt32(chunk->sizeY);
 
     // send chunk contents
-    for (uint32_t i = 0; i < chunk.sizeX; i++)
+    for (uint32_t i = 0; i < chunk->sizeX; i++)
     {
-        for (uint32_t j = 0; j < chunk.sizeY; j++)
+        for (uint32_t j = 0; j < chunk->sizeY; j++)
         {
-            pkt.WriteUInt16(chunk.fields[i][j].type);
-            pkt.WriteUInt32(chunk.fields[i][j].texture);
-            pkt.WriteUInt32(chunk.fields[i][j].flags);
+            pkt.WriteUInt16(chunk->fields[i][j].type);
+            pkt.WriteUInt32(chunk->fields[i][j].texture);
+            pkt.WriteUInt32(chunk->fields[i][j].flags);
         }
     }
 
+    sMapStorage->ReleaseChunk(chunk);
+
     sess->SendPacket(pkt);
 }
 
@@ -304,10 +303,13 @@ void PacketHandlers::HandleMapChunkChecksumVerify(Session* sess, SmartPacket& pa
 
     std::string checksum = packet.ReadString();
 
-    // retrieve map record, secure bounds and verify checksum
+    // retrieve map record, secure bounds and verify checksum; compare with stored checksum, so the chunk does not
+    // have to be loaded - unknown chunk is reported as mismatch
     MapRecord* mrec = sMapStorage->GetMapRecord(mapId);
-    if (!mrec || chunkIndexX >= mrec->chunks.size() || chunkIndexY >= mrec->chunks[chunkIndexX].size() ||
-        mrec->chunks[chunkIndexX][chunkIndexY].checksum == checksum)
+    MapChunkRecord* chunk = mrec ? mrec->GetChunk(chunkIndexX, chunkIndexY) : nullptr;
+    bool matches = (chunk && !chunk->checksum.empty() && chunk->checksum == checksum);
+
+    if (matches)
     {
         SmartPacket pkt(SP_MAP_CHUNK_VERIFY_CHECKSUM);
         pkt.WriteUInt8(GENERIC_STATUS_OK);
@@ -412,7 +414,14 @@ void PacketHandlers::HandleMoveStartDir(Session* sess, SmartPacket& packet)
 {
     uint8_t direction = packet.ReadUInt8() & 0xF;
 
-    sess->GetPlayer()->StartMoving((MoveDirectionElement)direction);
+    Map* map = sess->GetPlayer()->GetMap();
+    if (!map)
+        return;
+
+    // movement is applied within map update
+    map->PostObjectCommand(sess->GetPlayer()->GetGUID(), [direction](WorldObject* obj) {
+        obj->ToPlayer()->StartMoving((MoveDirectionElement)direction);
+    });
 }
 
 void PacketHandlers::HandleMoveStopDir(Session* sess, SmartPacket& packet)
@@ -423,9 +432,15 @@ void PacketHandlers::HandleMoveStopDir(Session* sess, SmartPacket& packet)
 
     // TODO: verify if this is possible, anticheat, etc.
 
-    sess->GetPlayer()->RelocateWithinMap(x, y);
+    Map* map = sess->GetPlayer()->GetMap();
+    if (!map)
+        return;
 
-    sess->GetPlayer()->StopMoving((MoveDirectionElement)direction);
+    // movement is applied within map update
+    map->PostObjectCommand(sess->GetPlayer()->GetGUID(), [direction, x, y](WorldObject* obj) {
+        obj->RelocateWithinMap(x, y);
+        obj->ToPlayer()->StopMoving((MoveDirectionElement)direction);
+    });
 }
 
 void PacketHandlers::HandleMoveHeartbeat(Session* sess, SmartPacket& packet)
@@ -435,18 +450,25 @@ void PacketHandlers::HandleMoveHeartbeat(Session* sess, SmartPacket& packet)
 
     // TODO: verify if this is possible, anticheat, etc.
 
-    Player* plr = sess->GetPlayer();
-
-    plr->RelocateWithinMap(x, y);
+    Map* map = sess->GetPlayer()->GetMap();
+    if (!map)
+        return;
 
     // TODO: timer, limit maximum count of heartbeats per second
 
-    SmartPacket pkt(SP_MOVE_HEARTBEAT);
-    pkt.WriteUInt64(plr->GetGUID());
-    pkt.WriteUInt8(plr->GetMoveMask());
-    pkt.WriteFloat(x);
-    pkt.WriteFloat(y);
-    plr->SendPacketToSorroundings(pkt);
+    // movement is applied within map update
+    map->PostObjectCommand(sess->GetPlayer()->GetGUID(), [x, y](WorldObject* obj) {
+        Player* plr = obj->ToPlayer();
+
+        plr->RelocateWithinMap(x, y);
+
+        SmartPacket pkt(SP_MOVE_HEARTBEAT);
+        pkt.WriteUInt64(plr->GetGUID());
+        pkt.WriteUInt8(plr->GetMoveMask());
+        pkt.WriteFloat(x);
+        pkt.WriteFloat(y);
+        plr->SendPacketToSorroundings(pkt);
+    });
 }
 
 void PacketHandlers::HandleChatMessage(Session* sess, SmartPacket& packet)
@@ -36,7 +36,7 @@ enum StateRestrictionMask
     STATE_RESTRICTION_AUTH          = 1 << CONNECTION_STATE_AUTH,
     STATE_RESTRICTION_LOBBY         = 1 << CONNECTION_STATE_LOBBY,
     STATE_RESTRICTION_GAME          = 1 << CONNECTION_STATE_INGAME,
-    STATE_RESTRICTION_VERIFIED      = 1 << CONNECTION_STATE_LOBBY | 1 << CONNECTION_STATE_INGAME,
+    STATE_RESTRICTION_VERIFIED      = 1 << CONNECTION_STATE_LOBBY | 1 << CONNECTION_STATE_INGAME | 1 << CONNECTION_STATE_LOADING,
 };
 
 /*
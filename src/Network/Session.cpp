@@ -31,6 +31,7 @@ Session::Session(SOCK socket, sockaddr_in sockAddr, uint32_t sessionId) : m_sess
 {
     m_connectionState = CONNECTION_STATE_AUTH;
     m_isExpired = false;
+    m_openSendSlot = nullptr;
 }
 
 Session::~Session()
@@ -96,10 +97,15 @@ void Session::SendPacket(SmartPacket &packet)
     // write contents
     memcpy(ppkt->data + 4, packet.GetData(), packet.GetSize());
 
+    ppkt->reserved = false;
+
     std::unique_lock<std::mutex> lck(m_packetSendQueueMutex);
 
     // queue packet
     m_packetSendQueue.push(ppkt);
+
+    // places reserved from now on are queued behind this packet
+    m_openSendSlot = nullptr;
 }
 
 void Session::SendQueuedPackets()
@@ -112,6 +118,10 @@ void Session::SendQueuedPackets()
     {
         ppkt = m_packetSendQueue.front();
 
+        // packets of reserved place are not serialized yet; everything behind them has to wait
+        if (ppkt->reserved)
+            break;
+
         // send packet if socket not busy
         if (sNetwork->SendPacket(ppkt->len, ppkt->data, m_socket))
             m_packetSendQueue.pop(); // remove from queue
@@ -124,6 +134,44 @@ void Session::SendQueuedPackets()
     }
 }
 
+ProcessedPacket* Session::ReserveSendSlot()
+{
+    std::unique_lock<std::mutex> lck(m_packetSendQueueMutex);
+
+    // reuse reserved place, if nothing was queued behind it yet
+    if (m_openSendSlot)
+        return m_openSendSlot;
+
+    m_openSendSlot = new ProcessedPacket;
+    m_openSendSlot->len = 0;
+    m_openSendSlot->data = nullptr;
+    m_openSendSlot->reserved = true;
+
+    m_packetSendQueue.push(m_openSendSlot);
+
+    return m_openSendSlot;
+}
+
+void Session::CloseSendSlot(ProcessedPacket* slot)
+{
+    std::unique_lock<std::mutex> lck(m_packetSendQueueMutex);
+
+    if (m_openSendSlot == slot)
+        m_openSendSlot = nullptr;
+}
+
+void Session::FillSendSlot(ProcessedPacket* slot, std::vector<uint8_t> const& data)
+{
+    std::unique_lock<std::mutex> lck(m_packetSendQueueMutex);
+
+    slot->len = (int)data.size();
+    slot->data = new uint8_t[data.size() > 0 ? data.size() : 1];
+    if (data.size() > 0)
+        memcpy(slot->data, data.data(), data.size());
+
+    slot->reserved = false;
+}
+
 void Session::AddPacketToHandleQueue(SmartPacket *packet)
 {
     m_packetHandleQueue.push(packet);
@@ -184,28 +232,63 @@ Player* Session::GetPlayer()
     return m_player;
 }
 
+// posts command removing, saving and destroying logged out player within update of the map he's in (or heading to)
+static void PostPlayerLogout(Map* m, Player* plr)
+{
+    m->PostCommand([m, plr]() {
+        Map* current = plr->GetMap();
+
+        // an earlier command moved the player to another map, and his addition may still be queued there
+        if (!current && (plr->GetMapId() != m->GetMapID() || plr->GetInstanceId() != m->GetInstanceID()))
+        {
+            Map* target = sMapManager->FindMap(plr->GetMapId(), plr->GetInstanceId());
+            if (target)
+            {
+                PostPlayerLogout(target, plr);
+                return;
+            }
+
+            // the target map is still being loaded
+            sMapManager->CancelPendingPlayer(plr);
+        }
+
+        // the player may be in any map by now, not just the one the command was posted to
+        if (current)
+            current->RemoveFromMap(plr);
+
+        plr->SaveToDB();
+        sObjectAccessor->RetireObject(plr);
+    });
+}
+
 void Session::Logout()
 {
     Player* plr = GetPlayer();
     if (plr)
     {
-        // remove player from map if in map
-        if (plr->GetMapId())
+        SetPlayer(nullptr);
+
+        // player in map (or being added to it) is removed, saved and destroyed within map update; since now, he won't receive any packets
+        if (m_connectionState == CONNECTION_STATE_INGAME)
         {
-            Map* m = sMapManager->GetMap(plr->GetMapId());
+            Map* m = sMapManager->FindMap(plr->GetMapId(), plr->GetInstanceId());
             if (m)
-                m->RemoveFromMap(plr);
+            {
+                plr->DetachSession();
+
+                PostPlayerLogout(m, plr);
+                return;
+            }
         }
+        // stop waiting for the map to be loaded
+        else if (m_connectionState == CONNECTION_STATE_LOADING)
+            sMapManager->CancelPendingPlayer(plr);
 
         // save player record to database
         plr->SaveToDB();
 
-        // remove object from world
-        sObjectAccessor->RemoveObject(plr->GetGUID());
-
-        // destroy
-        delete plr;
-        SetPlayer(nullptr);
+        // remove object from world and destroy it once nobody refers to it
+        sObjectAccessor->RetireObject(plr);
     }
 }
 
@@ -29,6 +29,8 @@ struct ProcessedPacket
 {
     int len;
     uint8_t* data;
+    // is this just a place reserved for packets, that are not serialized yet?
+    bool reserved;
 };
 
 // enumerator of connection states
@@ -38,6 +40,7 @@ enum ConnectionState
     CONNECTION_STATE_AUTH = 1,
     CONNECTION_STATE_LOBBY = 2,
     CONNECTION_STATE_INGAME = 3,
+    CONNECTION_STATE_LOADING = 4,
     MAX_CONN_STATE
 };
 
@@ -66,6 +69,12 @@ class Session
         void SendPacket(SmartPacket &packet);
         // sends all queued packets (if socket not busy)
         void SendQueuedPackets();
+        // reserves place in send queue for packets serialized later by another thread; packets sent meanwhile are queued behind it
+        ProcessedPacket* ReserveSendSlot();
+        // closes reserved place, so packets reserved since now are not merged into it
+        void CloseSendSlot(ProcessedPacket* slot);
+        // fills reserved place with serialized packets and allows queue to be sent past it
+        void FillSendSlot(ProcessedPacket* slot, std::vector<uint8_t> const& data);
         // handle all incoming packets
         void HandleQueuedPackets();
 
@@ -132,6 +141,8 @@ class Session
         std::queue<ProcessedPacket*> m_packetSendQueue;
         // mutex for locking packet send queue
         std::mutex m_packetSendQueueMutex;
+        // reserved place at the end of send queue, which may still receive packets
+        ProcessedPacket* m_openSendSlot;
 };
 
 #endif
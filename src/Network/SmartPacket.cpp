@@ -182,6 +182,11 @@ void SmartPacket::WriteString(const char* str)
     _Write((void*)str, strlen(str) + 1);
 }
 
+void SmartPacket::WriteData(const uint8_t* data, size_t size)
+{
+    _Write((void*)data, size);
+}
+
 void SmartPacket::WriteUInt64(uint64_t val)
 {
     val = htonll(val);
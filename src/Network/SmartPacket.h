@@ -123,6 +123,8 @@ class SmartPacket
         void WriteInt8(int8_t val);
         // Writes 32bit floating point number on current location
         void WriteFloat(float val);
+        // Writes raw (already serialized) data on current location
+        void WriteData(const uint8_t* data, size_t size);
 
         // Writes 32bit unsigned integer at specified position
         void WriteUInt32At(uint32_t val, uint16_t position);
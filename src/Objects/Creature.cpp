@@ -24,6 +24,10 @@
 #include "CreatureScript.h"
 #include "ScriptManager.h"
 #include "Player.h"
+#include "SlabAllocator.h"
+
+// allocator of all creatures
+static SlabAllocator creatureAllocator(sizeof(Creature));
 
 Creature::Creature() : Unit(OTYPE_CREATURE)
 {
@@ -33,7 +37,7 @@ Creature::Creature() : Unit(OTYPE_CREATURE)
 
 Creature::~Creature()
 {
-    //
+    delete m_script;
 }
 
 void Creature::Create(uint32_t guidLow, uint32_t entry)
@@ -88,12 +92,26 @@ void Creature::MovementGeneratorPointReached(uint32_t pointId)
         m_script->OnMovementPointReached(pointId);
 }
 
+void* Creature::operator new(size_t size)
+{
+    void* ptr = creatureAllocator.Allocate(size);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void Creature::operator delete(void* ptr)
+{
+    creatureAllocator.Free(ptr);
+}
+
 void Creature::CreateUpdateFields()
 {
     m_maxUpdateFieldIndex = UNIT_FIELDS_END;
 
-    m_updateFields = new uint32_t[m_maxUpdateFieldIndex];
-    m_updateFieldsChangeBits = new uint32_t[1 + (m_maxUpdateFieldIndex / 32)];
+    m_updateFields = m_creatureUpdateFields;
+    m_updateFieldsChangeBits = m_creatureUpdateFieldsChangeBits;
 
     memset(m_updateFields, 0, sizeof(uint32_t) * m_maxUpdateFieldIndex);
     memset(m_updateFieldsChangeBits, 0, sizeof(uint32_t) * (1 + (m_maxUpdateFieldIndex / 32)));
@@ -34,6 +34,10 @@ class Creature : public Unit
         Creature();
         virtual ~Creature();
 
+        // creatures are allocated from slab allocator
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
         // sets creature spawn position
         void SetSpawnPosition(float x, float y);
         // retrieves creature spawn position
@@ -56,7 +60,10 @@ class Creature : public Unit
         Position m_spawnPosition;
 
     private:
-        //
+        // updatefields storage, laid out inline with the creature
+        CACHELINE_ALIGNED uint32_t m_creatureUpdateFields[UNIT_FIELDS_END];
+        // updatefields "needs update" flags storage
+        uint32_t m_creatureUpdateFieldsChangeBits[UPDATEFIELD_CHANGEBITS_SIZE(UNIT_FIELDS_END)];
 };
 
 #endif
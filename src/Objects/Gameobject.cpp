@@ -22,6 +22,10 @@
 #include "GameobjectStorage.h"
 #include "Log.h"
 #include "SmartPacket.h"
+#include "SlabAllocator.h"
+
+// allocator of all gameobjects
+static SlabAllocator gameobjectAllocator(sizeof(Gameobject));
 
 Gameobject::Gameobject() : WorldObject(OTYPE_GAMEOBJECT)
 {
@@ -61,12 +65,26 @@ void Gameobject::BuildCreatePacketBlock(SmartPacket &pkt)
     pkt.WriteFloat(m_position.y);
 }
 
+void* Gameobject::operator new(size_t size)
+{
+    void* ptr = gameobjectAllocator.Allocate(size);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void Gameobject::operator delete(void* ptr)
+{
+    gameobjectAllocator.Free(ptr);
+}
+
 void Gameobject::CreateUpdateFields()
 {
     m_maxUpdateFieldIndex = GAMEOBJECT_FIELDS_END;
 
-    m_updateFields = new uint32_t[m_maxUpdateFieldIndex];
-    m_updateFieldsChangeBits = new uint32_t[1 + (m_maxUpdateFieldIndex / 32)];
+    m_updateFields = m_gameobjectUpdateFields;
+    m_updateFieldsChangeBits = m_gameobjectUpdateFieldsChangeBits;
 
     memset(m_updateFields, 0, sizeof(uint32_t) * m_maxUpdateFieldIndex);
     memset(m_updateFieldsChangeBits, 0, sizeof(uint32_t) * (1 + (m_maxUpdateFieldIndex / 32)));
@@ -33,6 +33,10 @@ class Gameobject : public WorldObject
         Gameobject();
         virtual ~Gameobject();
 
+        // gameobjects are allocated from slab allocator
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
         virtual void BuildCreatePacketBlock(SmartPacket &pkt);
 
         virtual void Create(uint32_t guidLow, uint32_t entry);
@@ -43,7 +47,10 @@ class Gameobject : public WorldObject
         virtual void CreateUpdateFields();
 
     private:
-        //
+        // updatefields storage, laid out inline with the gameobject
+        CACHELINE_ALIGNED uint32_t m_gameobjectUpdateFields[GAMEOBJECT_FIELDS_END];
+        // updatefields "needs update" flags storage
+        uint32_t m_gameobjectUpdateFieldsChangeBits[UPDATEFIELD_CHANGEBITS_SIZE(GAMEOBJECT_FIELDS_END)];
 };
 
 #endif
@@ -21,6 +21,7 @@
 #include "GuidMap.h"
 
 #define CHUNK_BITS (sizeof(uint64_t)*CHAR_BIT)
+#define FULL_CHUNK (~(uint64_t)0)
 
 GuidMap::GuidMap()
 {
@@ -34,11 +35,13 @@ GuidMap::~GuidMap()
         free(m_slices[i]);
 
     free(m_slices);
+    free(m_fullSlices);
 }
 
 void GuidMap::Init(uint64_t sliceBits)
 {
     m_sliceSize = (sliceBits / CHUNK_BITS) + !!(sliceBits % CHUNK_BITS);
+    m_summarySize = (m_sliceSize / CHUNK_BITS) + !!(m_sliceSize % CHUNK_BITS);
 
     // skip GUID 0, it is used as special value and musn't be assigned
     SetBit(0);
@@ -51,9 +54,24 @@ void GuidMap::SetBit(int64_t index)
 
     // if slice offset exceeds allocated slices, allocate one more slice
     while (sliceOffset + 1 > m_sliceCount)
-        _AddSlice();
+    {
+        if (!_AddSlice())
+            return;
+    }
+
+    _SetBit(sliceOffset, sliceIndex);
+}
+
+void GuidMap::ClearBit(int64_t index)
+{
+    uint64_t sliceOffset = index / (m_sliceSize*CHUNK_BITS);
+    uint64_t sliceIndex = index % (m_sliceSize*CHUNK_BITS);
+
+    // GUID 0 is reserved, and slices not allocated contain no used bits
+    if (index == 0 || sliceOffset + 1 > m_sliceCount)
+        return;
 
-    _SetBit(m_slices[sliceOffset], sliceIndex);
+    _ClearBit(sliceOffset, sliceIndex);
 }
 
 bool GuidMap::GetBit(int64_t index)
@@ -65,77 +83,244 @@ bool GuidMap::GetBit(int64_t index)
     if (sliceOffset + 1 > m_sliceCount)
         return false;
 
-    return _GetBit(m_slices[sliceOffset], sliceIndex);
+    return _GetBit(sliceOffset, sliceIndex);
 }
 
 int64_t GuidMap::UseEmpty()
 {
-    uint64_t i;
     int64_t ret;
 
-    // try to find empty bit in current slice set
-    for (i = 0; i < m_sliceCount; i++)
+    if (UseEmptyRange(&ret, 1) == 0)
+        return -1;
+
+    return ret;
+}
+
+uint32_t GuidMap::UseEmptyRange(int64_t* guids, uint32_t count)
+{
+    uint64_t slice, word, empty, bit;
+    int64_t ret;
+    uint32_t taken = 0;
+
+    slice = _FindNonFullSlice();
+
+    // all allocated slices are full, allocate another one
+    if (slice >= m_sliceCount)
     {
-         ret = _FindEmpty(m_slices[i], m_sliceSize);
-        if (ret != -1)
-        {
-            _SetBit(m_slices[i], ret);
-            return i*m_sliceSize*CHUNK_BITS + ret;
-        }
+        if (!_AddSlice())
+            return 0;
+        slice = m_sliceCount - 1;
+    }
+
+    // everything below is full, next search may start here
+    m_freeHint = slice;
+
+    ret = _FindEmpty(slice);
+    if (ret == -1)
+        return 0;
+
+    // take empty spots of the word in ascending order
+    word = ret / CHUNK_BITS;
+    empty = ~m_slices[slice][word];
+    while (empty != 0 && taken < count)
+    {
+        bit = custom_ctz64(empty);
+        empty &= empty - 1;
+
+        _SetBit(slice, word*CHUNK_BITS + bit);
+        guids[taken++] = slice*m_sliceSize*CHUNK_BITS + word*CHUNK_BITS + bit;
+    }
+
+    return taken;
+}
+
+bool GuidMap::SaveToFile(FILE* f)
+{
+    // header - slice size and count, then raw slice words without summaries
+    if (fwrite(&m_sliceSize, sizeof(uint64_t), 1, f) != 1 || fwrite(&m_sliceCount, sizeof(uint64_t), 1, f) != 1)
+        return false;
+
+    for (uint64_t i = 0; i < m_sliceCount; i++)
+    {
+        if (fwrite(m_slices[i], sizeof(uint64_t), (size_t)m_sliceSize, f) != m_sliceSize)
+            return false;
+    }
+
+    return true;
+}
+
+bool GuidMap::LoadFromFile(FILE* f)
+{
+    uint64_t sliceSize, sliceCount, i;
+
+    if (fread(&sliceSize, sizeof(uint64_t), 1, f) != 1 || fread(&sliceCount, sizeof(uint64_t), 1, f) != 1)
+        return false;
+
+    // granularity has changed
+    if (sliceSize != m_sliceSize)
+        return false;
+
+    // read everything at first, so the guidmap stays intact when the file is damaged
+    std::vector<uint64_t> words((size_t)(sliceSize * sliceCount));
+    if (!words.empty() && fread(words.data(), sizeof(uint64_t), words.size(), f) != words.size())
+        return false;
+
+    while (m_sliceCount < sliceCount)
+    {
+        if (!_AddSlice())
+            return false;
+    }
+
+    for (i = 0; i < sliceCount; i++)
+    {
+        memcpy(m_slices[i], &words[(size_t)(i * sliceSize)], (size_t)sliceSize * sizeof(uint64_t));
+        _RebuildSummary(i);
+    }
+
+    // GUID 0 is reserved even if the file says otherwise
+    SetBit(0);
+
+    m_freeHint = 0;
+
+    return true;
+}
+
+void GuidMap::_SetBit(uint64_t slice, uint64_t idx)
+{
+    uint64_t* arr = m_slices[slice];
+    uint64_t* summary = arr + m_sliceSize;
+    uint64_t word = idx / CHUNK_BITS;
+    uint64_t i;
+
+    arr[word] |= ((uint64_t)1LL << (idx % CHUNK_BITS));
+
+    if (arr[word] != FULL_CHUNK)
+        return;
+
+    // the word became full, propagate to slice summary
+    summary[word / CHUNK_BITS] |= ((uint64_t)1LL << (word % CHUNK_BITS));
+
+    for (i = 0; i < m_summarySize; i++)
+    {
+        if (summary[i] != FULL_CHUNK)
+            return;
     }
 
-    // allocate another slice and take the first bit there
-    _AddSlice();
-    _SetBit(m_slices[i], 0);
-    return i*m_sliceSize*CHUNK_BITS;
+    // the whole slice became full
+    m_fullSlices[slice / CHUNK_BITS] |= ((uint64_t)1LL << (slice % CHUNK_BITS));
 }
 
-void GuidMap::_SetBit(uint64_t *arr, int64_t idx)
+void GuidMap::_ClearBit(uint64_t slice, uint64_t idx)
 {
-    arr[idx / CHUNK_BITS] |= ((uint64_t)1LL << (idx % CHUNK_BITS));
+    uint64_t* arr = m_slices[slice];
+    uint64_t* summary = arr + m_sliceSize;
+    uint64_t word = idx / CHUNK_BITS;
+
+    arr[word] &= ~((uint64_t)1LL << (idx % CHUNK_BITS));
+
+    // neither the word nor the slice is full anymore
+    summary[word / CHUNK_BITS] &= ~((uint64_t)1LL << (word % CHUNK_BITS));
+    m_fullSlices[slice / CHUNK_BITS] &= ~((uint64_t)1LL << (slice % CHUNK_BITS));
+
+    if (slice < m_freeHint)
+        m_freeHint = slice;
 }
 
-bool GuidMap::_GetBit(uint64_t *arr, int64_t idx)
+bool GuidMap::_GetBit(uint64_t slice, uint64_t idx)
 {
-    return (arr[idx / CHUNK_BITS] & ((uint64_t)1LL << (idx % CHUNK_BITS))) != 0;
+    return (m_slices[slice][idx / CHUNK_BITS] & ((uint64_t)1LL << (idx % CHUNK_BITS))) != 0;
 }
 
-int64_t GuidMap::_FindEmpty(uint64_t *arr, uint64_t arrsize)
+int64_t GuidMap::_FindEmpty(uint64_t slice)
 {
-    uint64_t i, j;
+    uint64_t* arr = m_slices[slice];
+    uint64_t* summary = arr + m_sliceSize;
+    uint64_t i, word;
 
-    // skip full chunks
-    for (i = 0; i < arrsize; i++)
+    // find summary word referring to at least one word with empty spot
+    for (i = 0; i < m_summarySize; i++)
     {
-        if (arr[i] != ~(uint64_t)0)
+        if (summary[i] != FULL_CHUNK)
             break;
     }
 
     // we are full, no space available at all
-    if (i == arrsize)
+    if (i == m_summarySize)
         return -1;
 
-    // we found first free long, find empty space within
-    for (j = 0; j < CHUNK_BITS; j++)
+    // first word with empty spot, and the first empty spot within
+    word = i*CHUNK_BITS + custom_ctz64(~summary[i]);
+
+    return word*CHUNK_BITS + custom_ctz64(~arr[word]);
+}
+
+uint64_t GuidMap::_FindNonFullSlice()
+{
+    uint64_t i;
+
+    // slices below free hint are full, skip them
+    for (i = m_freeHint / CHUNK_BITS; i < m_fullSlicesSize; i++)
     {
-        if (~arr[i] & (uint64_t)1LL << j)
-            break;
+        if (m_fullSlices[i] != FULL_CHUNK)
+            return i*CHUNK_BITS + custom_ctz64(~m_fullSlices[i]);
     }
 
-    // resulting bit offset is i*bits_in_chunk + j
-    return i*CHUNK_BITS + j;
+    return m_fullSlicesSize*CHUNK_BITS;
+}
+
+void GuidMap::_RebuildSummary(uint64_t slice)
+{
+    uint64_t* arr = m_slices[slice];
+    uint64_t* summary = arr + m_sliceSize;
+    uint64_t i;
+    bool full = true;
+
+    for (i = 0; i < m_sliceSize; i++)
+    {
+        if (arr[i] == FULL_CHUNK)
+            summary[i / CHUNK_BITS] |= ((uint64_t)1LL << (i % CHUNK_BITS));
+        else
+        {
+            summary[i / CHUNK_BITS] &= ~((uint64_t)1LL << (i % CHUNK_BITS));
+            full = false;
+        }
+    }
+
+    if (full)
+        m_fullSlices[slice / CHUNK_BITS] |= ((uint64_t)1LL << (slice % CHUNK_BITS));
+    else
+        m_fullSlices[slice / CHUNK_BITS] &= ~((uint64_t)1LL << (slice % CHUNK_BITS));
 }
 
 bool GuidMap::_AddSlice()
 {
-    uint64_t arrayNum;
-    uint64_t *newarray, **arrays;
+    uint64_t arrayNum, i;
+    uint64_t *newarray, **arrays, *fullSlices;
 
-    // allocate new slice, initialize to zero
-    newarray = (uint64_t*)calloc(m_sliceSize, sizeof(uint64_t));
+    // allocate new slice along with its summary, initialize to zero
+    newarray = (uint64_t*)calloc(m_sliceSize + m_summarySize, sizeof(uint64_t));
     if (newarray == NULL)
         return false;
 
+    // summary bits beyond slice size do not refer to any word, mark them full
+    for (i = m_sliceSize; i < m_summarySize*CHUNK_BITS; i++)
+        newarray[m_sliceSize + i / CHUNK_BITS] |= ((uint64_t)1LL << (i % CHUNK_BITS));
+
+    // extend summary of full slices, if needed
+    if (m_sliceCount + 1 > m_fullSlicesSize*CHUNK_BITS)
+    {
+        fullSlices = (uint64_t*)realloc(m_fullSlices, (m_fullSlicesSize + 1)*sizeof(uint64_t));
+        if (fullSlices == NULL)
+        {
+            free(newarray);
+            return false;
+        }
+
+        fullSlices[m_fullSlicesSize] = 0;
+        m_fullSlices = fullSlices;
+        m_fullSlicesSize++;
+    }
+
     // resize slices array to be able to contain new slice
     arrayNum = m_sliceCount + 1;
     arrays = (uint64_t**)realloc(m_slices, arrayNum*sizeof(uint64_t*));
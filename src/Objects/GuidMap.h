@@ -21,7 +21,8 @@
 #define BW_GUIDMAP_H
 
 /*
- * Class used as bitmap for specific guidspace
+ * Class used as bitmap for specific guidspace; every slice has its summary of full words, and the guidmap
+ * keeps summary of full slices, so the empty spot is found using few count-trailing-zeros operations
  */
 class GuidMap
 {
@@ -33,27 +34,50 @@ class GuidMap
         void Init(uint64_t sliceBits);
         // sets bit in guidmap
         void SetBit(int64_t index);
+        // clears bit in guidmap (GUID is free to be assigned again)
+        void ClearBit(int64_t index);
         // finds empty spot, marks as used and returns its index (allocated GUID)
         int64_t UseEmpty();
+        // finds up to count empty spots within one bitmap word, marks them as used and stores their indexes; returns count of found spots
+        uint32_t UseEmptyRange(int64_t* guids, uint32_t count);
         // retrieves bit value (is GUID in use?)
         bool GetBit(int64_t index);
 
+        // writes guidmap contents to opened file
+        bool SaveToFile(FILE* f);
+        // reads guidmap contents from opened file; the guidmap must be initialized with the same granularity
+        bool LoadFromFile(FILE* f);
+
     private:
-        // internal method for setting bit value
-        void _SetBit(uint64_t *arr, int64_t idx);
-        // internal method for retrieving bit value
-        bool _GetBit(uint64_t *arr, int64_t idx);
-        // internal method for finding empty spot in bitmap
-        int64_t _FindEmpty(uint64_t *arr, uint64_t arrsize);
+        // internal method for setting bit value within slice, updates summaries
+        void _SetBit(uint64_t slice, uint64_t idx);
+        // internal method for clearing bit value within slice, updates summaries
+        void _ClearBit(uint64_t slice, uint64_t idx);
+        // internal method for retrieving bit value within slice
+        bool _GetBit(uint64_t slice, uint64_t idx);
+        // internal method for finding empty spot in slice; returns -1 if the slice is full
+        int64_t _FindEmpty(uint64_t slice);
+        // internal method for finding first slice which is not full; may return index of slice not allocated yet
+        uint64_t _FindNonFullSlice();
+        // rebuilds both summary levels of slice from its words
+        void _RebuildSummary(uint64_t slice);
         // adds next slice (extends guidmap)
         bool _AddSlice();
 
-        // slice map (bitmap divided into 64bit smaller maps)
+        // slice map (bitmap divided into 64bit smaller maps); every slice is followed by its summary words
         uint64_t **m_slices;
         // total slice count at the moment
         uint64_t m_sliceCount;
-        // current slice size
+        // current slice size (in 64bit words, without summary)
         uint64_t m_sliceSize;
+        // size of slice summary (in 64bit words); summary bit is set when the corresponding slice word is full
+        uint64_t m_summarySize;
+        // summary of full slices; bit is set when the corresponding slice is full
+        uint64_t *m_fullSlices;
+        // size of full slices summary (in 64bit words)
+        uint64_t m_fullSlicesSize;
+        // free hint - all slices below this index are full
+        uint64_t m_freeHint;
 };
 
 #endif
@@ -33,7 +33,6 @@ FollowMovementGenerator::FollowMovementGenerator(Unit* owner) : MovementGenerato
     m_lastPointTime = 0;
     m_followDistance = 1.0f;
     m_maxDistance = 2.0f;
-    m_followGUID = 0;
     m_lastCheckTime = 0;
 }
 
@@ -78,7 +77,7 @@ void FollowMovementGenerator::ReceiveChildSignal(uint32_t signalId, uint32_t par
 
 bool FollowMovementGenerator::CheckFollowerDistance()
 {
-    WorldObject* target = sObjectAccessor->FindWorldObject(m_followGUID);
+    WorldObject* target = sObjectAccessor->FindWorldObject(m_followHandle);
     // if the target is unreachable, terminate movement and return true (to avoid finding close point)
     if (!target || target->GetMapId() != m_owner->GetMapId())
     {
@@ -102,7 +101,7 @@ void FollowMovementGenerator::StartFollowing(Unit* target, float followDistance,
         return;
     }
 
-    m_followGUID = target->GetGUID();
+    m_followHandle = sObjectAccessor->GetObjectHandle(target->GetGUID());
     m_followDistance = followDistance;
     m_maxDistance = maxDistance;
     m_lastCheckTime = 0;
@@ -114,7 +113,7 @@ void FollowMovementGenerator::StartFollowing(Unit* target, float followDistance,
 
 void FollowMovementGenerator::MoveToClosePoint()
 {
-    WorldObject* target = sObjectAccessor->FindWorldObject(m_followGUID);
+    WorldObject* target = sObjectAccessor->FindWorldObject(m_followHandle);
     // if the target is unreachable, terminate movement and return true (to avoid finding close point)
     if (!target || target->GetMapId() != m_owner->GetMapId())
     {
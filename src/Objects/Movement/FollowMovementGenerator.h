@@ -21,6 +21,7 @@
 #define BW_FOLLOWMOVEMENTGENERATOR_H
 
 #include "MovementGeneratorBase.h"
+#include "ObjectAccessor.h"
 
 class Unit;
 class PointMovementGenerator;
@@ -53,8 +54,8 @@ class FollowMovementGenerator : public MovementGeneratorBase
         void MoveToClosePoint();
 
     private:
-        // GUID of unit we follow
-        uint64_t m_followGUID;
+        // handle of unit we follow
+        ObjectHandle m_followHandle;
         // minimum follow distance - we will go there when we are too far away
         float m_followDistance;
         // maximum distance - a step further and we will go closer again
@@ -33,6 +33,12 @@ MotionMaster::MotionMaster(Unit* owner) : m_owner(owner)
     m_movementGenerator = nullptr;
 }
 
+MotionMaster::~MotionMaster()
+{
+    // do not finalize, the owner is being destroyed at this point
+    delete m_movementGenerator;
+}
+
 void MotionMaster::Initialize()
 {
     // start with "idle movement"
@@ -42,6 +42,7 @@ class MotionMaster
 {
     public:
         MotionMaster(Unit* owner);
+        ~MotionMaster();
 
         // initialize motion master - set idle type, etc.
         void Initialize();
@@ -134,8 +134,7 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
     pff = new PathfindFieldRecord(curX, curY, nullptr, 0.0f, CalculateHeuristic(curX, curY, dstX, dstY));
     PushPathfindRecord(pff);
 
-    PathfindField* pfm[4];
-    PathfindField* diagfld;
+    bool pfm[4];
 
     // while there's something to be processed and the pathfinding loop didn't exceed the limit
     while (!m_pathfindQueue.empty() && i < PATHFIND_ITERATIONS_LIMIT)
@@ -153,17 +152,17 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
         if (curX == dstX && curY == dstY)
             break;
 
-        pfm[0] = m_map->GetPathfindField(curX - 1, curY); // left
-        pfm[1] = m_map->GetPathfindField(curX + 1, curY); // right
-        pfm[2] = m_map->GetPathfindField(curX, curY - 1); // up
-        pfm[3] = m_map->GetPathfindField(curX, curY + 1); // down
+        pfm[0] = m_map->IsPathfindAccessible(curX - 1, curY, m_moveMask); // left
+        pfm[1] = m_map->IsPathfindAccessible(curX + 1, curY, m_moveMask); // right
+        pfm[2] = m_map->IsPathfindAccessible(curX, curY - 1, m_moveMask); // up
+        pfm[3] = m_map->IsPathfindAccessible(curX, curY + 1, m_moveMask); // down
 
         // the algorithm takes left/right/up/down directions first and checks, if they are accessible and "walkable" with movement type mask set
         // if yes, pushes them into priority queue for later processing; then the diagonal fields are taken, but only if their "elementary directions"
         // are accessible (i.e. left-up field is taken only if left AND up fields are accessible).
 
         // left
-        if (pfm[0] && (pfm[0]->moveType & m_moveMask) != 0)
+        if (pfm[0])
         {
             if (m_visitedSet.find(MP32(curX - 1, curY)) == m_visitedSet.end())
             {
@@ -171,11 +170,9 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
                 PushPathfindRecord(pfftr);
             }
         }
-        else
-            pfm[0] = nullptr;
 
         // right
-        if (pfm[1] && (pfm[1]->moveType & m_moveMask) != 0)
+        if (pfm[1])
         {
             if (m_visitedSet.find(MP32(curX + 1, curY)) == m_visitedSet.end())
             {
@@ -183,11 +180,9 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
                 PushPathfindRecord(pfftr);
             }
         }
-        else
-            pfm[1] = nullptr;
 
         // up
-        if (pfm[2] && (pfm[2]->moveType & m_moveMask) != 0)
+        if (pfm[2])
         {
             if (m_visitedSet.find(MP32(curX, curY - 1)) == m_visitedSet.end())
             {
@@ -195,11 +190,9 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
                 PushPathfindRecord(pfftr);
             }
         }
-        else
-            pfm[2] = nullptr;
 
         // down
-        if (pfm[3] && (pfm[3]->moveType & m_moveMask) != 0)
+        if (pfm[3])
         {
             if (m_visitedSet.find(MP32(curX, curY + 1)) == m_visitedSet.end())
             {
@@ -207,16 +200,13 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
                 PushPathfindRecord(pfftr);
             }
         }
-        else
-            pfm[3] = nullptr;
 
         // diagonal fields
 
         // left up
         if (pfm[0] && pfm[2])
         {
-            diagfld = m_map->GetPathfindField(curX - 1, curY - 1);
-            if (diagfld && (diagfld->moveType & m_moveMask) != 0 && m_visitedSet.find(MP32(curX - 1, curY - 1)) == m_visitedSet.end())
+            if (m_map->IsPathfindAccessible(curX - 1, curY - 1, m_moveMask) && m_visitedSet.find(MP32(curX - 1, curY - 1)) == m_visitedSet.end())
             {
                 pfftr = new PathfindFieldRecord(curX - 1, curY - 1, pff, pff->srcCost + sqrt(2.0f), CalculateHeuristic(curX - 1, curY - 1, dstX, dstY));
                 PushPathfindRecord(pfftr);
@@ -226,8 +216,7 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
         // left down
         if (pfm[0] && pfm[3])
         {
-            diagfld = m_map->GetPathfindField(curX - 1, curY + 1);
-            if (diagfld && (diagfld->moveType & m_moveMask) != 0 && m_visitedSet.find(MP32(curX - 1, curY + 1)) == m_visitedSet.end())
+            if (m_map->IsPathfindAccessible(curX - 1, curY + 1, m_moveMask) && m_visitedSet.find(MP32(curX - 1, curY + 1)) == m_visitedSet.end())
             {
                 pfftr = new PathfindFieldRecord(curX - 1, curY + 1, pff, pff->srcCost + sqrt(2.0f), CalculateHeuristic(curX - 1, curY + 1, dstX, dstY));
                 PushPathfindRecord(pfftr);
@@ -237,8 +226,7 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
         // right up
         if (pfm[1] && pfm[2])
         {
-            diagfld = m_map->GetPathfindField(curX + 1, curY - 1);
-            if (diagfld && (diagfld->moveType & m_moveMask) != 0 && m_visitedSet.find(MP32(curX + 1, curY - 1)) == m_visitedSet.end())
+            if (m_map->IsPathfindAccessible(curX + 1, curY - 1, m_moveMask) && m_visitedSet.find(MP32(curX + 1, curY - 1)) == m_visitedSet.end())
             {
                 pfftr = new PathfindFieldRecord(curX + 1, curY - 1, pff, pff->srcCost + sqrt(2.0f), CalculateHeuristic(curX + 1, curY - 1, dstX, dstY));
                 PushPathfindRecord(pfftr);
@@ -248,8 +236,7 @@ bool Pathfinder::FindPath(MotionPointVector& dstVector, uint32_t* outFlags)
         // right down
         if (pfm[1] && pfm[3])
         {
-            diagfld = m_map->GetPathfindField(curX + 1, curY + 1);
-            if (diagfld && (diagfld->moveType & m_moveMask) != 0 && m_visitedSet.find(MP32(curX + 1, curY + 1)) == m_visitedSet.end())
+            if (m_map->IsPathfindAccessible(curX + 1, curY + 1, m_moveMask) && m_visitedSet.find(MP32(curX + 1, curY + 1)) == m_visitedSet.end())
             {
                 pfftr = new PathfindFieldRecord(curX + 1, curY + 1, pff, pff->srcCost + sqrt(2.0f), CalculateHeuristic(curX + 1, curY + 1, dstX, dstY));
                 PushPathfindRecord(pfftr);
@@ -26,6 +26,7 @@ enum ObjectGUIDHigh
     HIGHGUID_PLAYER         = 0,
     HIGHGUID_CREATURE       = 1,
     HIGHGUID_GAMEOBJECT     = 2,
+    MAX_HIGHGUID
 };
 
 #define MAKE_GUID64(hi,en,lo) (((uint64_t)hi << 58LL) | (((uint64_t)en & 0x3FFFFFF) << 32LL) | ((uint64_t)lo & 0xFFFFFFFFLL))
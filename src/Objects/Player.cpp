@@ -25,6 +25,10 @@
 #include "Log.h"
 #include "ItemStorage.h"
 #include "ObjectAccessor.h"
+#include "SlabAllocator.h"
+
+// allocator of all players
+static SlabAllocator playerAllocator(sizeof(Player));
 
 Player::Player() : Unit(OTYPE_PLAYER)
 {
@@ -51,12 +55,26 @@ void Player::Update()
     Unit::Update();
 }
 
+void* Player::operator new(size_t size)
+{
+    void* ptr = playerAllocator.Allocate(size);
+    if (!ptr)
+        throw std::bad_alloc();
+
+    return ptr;
+}
+
+void Player::operator delete(void* ptr)
+{
+    playerAllocator.Free(ptr);
+}
+
 void Player::CreateUpdateFields()
 {
     m_maxUpdateFieldIndex = PLAYER_FIELDS_END;
 
-    m_updateFields = new uint32_t[m_maxUpdateFieldIndex];
-    m_updateFieldsChangeBits = new uint32_t[1 + (m_maxUpdateFieldIndex / 32)];
+    m_updateFields = m_playerUpdateFields;
+    m_updateFieldsChangeBits = m_playerUpdateFieldsChangeBits;
 
     memset(m_updateFields, 0, sizeof(uint32_t) * m_maxUpdateFieldIndex);
     memset(m_updateFieldsChangeBits, 0, sizeof(uint32_t) * (1 + (m_maxUpdateFieldIndex / 32)));
@@ -69,9 +87,39 @@ Session* Player::GetSession()
     return m_session;
 }
 
+void Player::DetachSession()
+{
+    m_session = nullptr;
+}
+
 void Player::SendPacketToMe(SmartPacket &pkt)
 {
-    m_session->SendPacket(pkt);
+    if (m_session)
+        m_session->SendPacket(pkt);
+}
+
+void Player::AddVisibleObject(WorldObject* obj)
+{
+    m_visibleObjects.insert(obj);
+}
+
+void Player::RemoveVisibleObject(WorldObject* obj)
+{
+    m_visibleObjects.erase(obj);
+}
+
+void Player::ClearVisibleObjects()
+{
+    std::set<WorldObject*> visible;
+    visible.swap(m_visibleObjects);
+
+    for (WorldObject* obj : visible)
+        obj->RemoveWatcher(this);
+}
+
+std::set<WorldObject*> const& Player::GetVisibleObjects()
+{
+    return m_visibleObjects;
 }
 
 void Player::FillInventoryPacket(SmartPacket &pkt)
@@ -381,6 +429,10 @@ void Player::SaveInventory()
         sMainDatabase.PExecute("DELETE FROM character_inventory WHERE guid = %u AND item_guid = %u", item->item.ownerGuid, item->item.itemGuid);
         sMainDatabase.PExecute("DELETE FROM item WHERE guid = %u", item->item.itemGuid);
 
+        // the item record no longer exists, so its GUID could be assigned again (and is not stored as used in guidspace snapshot)
+        sObjectAccessor->ReleaseItemGUID(item->item.itemGuid);
+
         delete item;
     }
+    m_pendingDeleteItems.clear();
 }
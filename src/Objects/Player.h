@@ -76,6 +76,10 @@ class Player : public Unit
         Player();
         virtual ~Player();
 
+        // players are allocated from slab allocator
+        static void* operator new(size_t size);
+        static void operator delete(void* ptr);
+
         virtual void Create(uint32_t guidLow, Session* session);
         virtual void Update();
 
@@ -86,9 +90,20 @@ class Player : public Unit
 
         // retrieves player session
         Session* GetSession();
+        // detaches player from session, i.e. when logging out; no more packets are sent to player since then
+        void DetachSession();
         // sends packet to this player
         void SendPacketToMe(SmartPacket &pkt);
 
+        // adds object to set of objects visible to player; called from WorldObject::AddWatcher
+        void AddVisibleObject(WorldObject* obj);
+        // removes object from set of objects visible to player; called from WorldObject::RemoveWatcher
+        void RemoveVisibleObject(WorldObject* obj);
+        // stops watching all objects visible to player
+        void ClearVisibleObjects();
+        // retrieves set of objects visible to player
+        std::set<WorldObject*> const& GetVisibleObjects();
+
         // fills prepared inventory packet with full inventory data
         void FillInventoryPacket(SmartPacket &pkt);
         // sends inventory slot update packet
@@ -121,6 +136,12 @@ class Player : public Unit
         InventoryItem* m_inventory[CHARACTER_INVENTORY_SLOTS];
         // items to be removed at next inventory save
         std::list<InventoryItem*> m_pendingDeleteItems;
+        // objects this player is watching
+        std::set<WorldObject*> m_visibleObjects;
+        // updatefields storage, laid out inline with the player
+        CACHELINE_ALIGNED uint32_t m_playerUpdateFields[PLAYER_FIELDS_END];
+        // updatefields "needs update" flags storage
+        uint32_t m_playerUpdateFieldsChangeBits[UPDATEFIELD_CHANGEBITS_SIZE(PLAYER_FIELDS_END)];
 };
 
 #endif
\ No newline at end of file
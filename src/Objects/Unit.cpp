@@ -50,7 +50,7 @@ void Unit::Update()
     m_motionMaster.Update();
 
     // update movement if the unit is moving
-    if (IsMoving())
+    if (IsMoving() && m_map)
     {
         const uint32_t msNow = getMSTime();
 
@@ -67,16 +67,16 @@ void Unit::Update()
             if (newX < 0.0f)
                 newX = 0.0f;
 
-            MapField* mf = GetMap()->GetField(newX, m_position.y);
-            if (!mf || !CanMoveOn((MapFieldType)mf->type, mf->flags))
+            const uint32_t moveMask = GetMovementTypeMask();
+
+            if (!m_map->CanMoveOn(newX, m_position.y, moveMask))
                 newX = m_position.x;
 
             newY = m_position.y + coef * m_moveVector.y;
             if (newY < 0.0f)
                 newY = 0.0f;
 
-            mf = GetMap()->GetField(newX, newY);
-            if (!mf || !CanMoveOn((MapFieldType)mf->type, mf->flags))
+            if (!m_map->CanMoveOn(newX, newY, moveMask))
                 newY = m_position.y;
 
             RelocateWithinMap(newX, newY);
@@ -124,10 +124,10 @@ void Unit::SetLevel(uint16_t lvl, bool onLoad)
     // TODO: things related to levelup / leveldown ?
 }
 
-bool Unit::CanMoveOn(MapFieldType type, uint32_t flags)
+uint32_t Unit::GetMovementTypeMask()
 {
     // for now just ground type
-    return (type == MFT_GROUND);
+    return (1 << MOVEMENT_TYPE_WALK);
 }
 
 void Unit::StartMoving(MoveDirectionElement dir)
@@ -135,10 +135,13 @@ void Unit::StartMoving(MoveDirectionElement dir)
     if ((m_moveMask & dir) != 0)
         return;
 
-    SmartPacket pkt(SP_MOVE_START_DIRECTION);
-    pkt.WriteUInt64(GetGUID());
-    pkt.WriteUInt8(dir);
-    SendPacketToSorroundings(pkt);
+    if (HasWatchers())
+    {
+        SmartPacket pkt(SP_MOVE_START_DIRECTION);
+        pkt.WriteUInt64(GetGUID());
+        pkt.WriteUInt8(dir);
+        SendPacketToSorroundings(pkt);
+    }
 
     // if started movement, set timers for movement update
     if (m_moveMask == 0)
@@ -153,12 +156,15 @@ void Unit::StopMoving(MoveDirectionElement dir)
     if ((m_moveMask & dir) == 0)
         return;
 
-    SmartPacket pkt(SP_MOVE_STOP_DIRECTION);
-    pkt.WriteUInt64(GetGUID());
-    pkt.WriteUInt8(dir);
-    pkt.WriteFloat(GetPositionX());
-    pkt.WriteFloat(GetPositionY());
-    SendPacketToSorroundings(pkt);
+    if (HasWatchers())
+    {
+        SmartPacket pkt(SP_MOVE_STOP_DIRECTION);
+        pkt.WriteUInt64(GetGUID());
+        pkt.WriteUInt8(dir);
+        pkt.WriteFloat(GetPositionX());
+        pkt.WriteFloat(GetPositionY());
+        SendPacketToSorroundings(pkt);
+    }
 
     m_moveMask &= ~dir;
     UpdateMovementVector();
@@ -104,8 +104,8 @@ class Unit : public WorldObject
         void Talk(TalkType type, const char* str);
         // talk using specified talk type and supplied string; sent only to one target
         void TalkTo(TalkType type, const char* str, Player* target);
-        // can the unit move over this field type?
-        bool CanMoveOn(MapFieldType type, uint32_t flags);
+        // retrieves mask of movement types (see MovementType enum) the unit is able to use
+        uint32_t GetMovementTypeMask();
         // retrieves unit current health
         uint32_t GetHealth();
         // retrieves unit maximum health
@@ -24,18 +24,25 @@
 #include "Player.h"
 #include "Creature.h"
 #include "SmartPacket.h"
+#include "Session.h"
 #include "ObjectAccessor.h"
 #include "ResourceStorage.h"
+#include "Log.h"
 
-WorldObject::WorldObject(ObjectType type) : m_position(0.0f, 0.0f), m_positionMap(0), m_objectType(type)
+WorldObject::WorldObject(ObjectType type) : m_position(0.0f, 0.0f), m_positionMap(0), m_positionInstance(MAP_BASE_INSTANCE_ID), m_objectType(type)
 {
+    m_updateFields = nullptr;
+    m_updateFieldsChangeBits = nullptr;
     m_updateFieldsNeedsUpdate = true;
+    m_createBlockCacheValid = false;
     m_name = "???";
+    m_mapCellSlot = MAP_CELL_SLOT_NONE;
+    m_map = nullptr;
 }
 
 WorldObject::~WorldObject()
 {
-    //
+    // updatefields are stored inline within child classes
 }
 
 void WorldObject::Create(uint64_t guid)
@@ -51,61 +58,65 @@ void WorldObject::Create(uint64_t guid)
 
 void WorldObject::Update()
 {
-    // if some of updatefields was changed, send update to sorroundings
+    // if some of updatefields was changed, capture changes to be sent to sorroundings
     if (m_updateFieldsNeedsUpdate)
     {
-        SmartPacket pkt(SP_UPDATE_OBJECT);
-        BuildUpdatePacketBlock(pkt);
-        SendPacketToSorroundings(pkt);
+        // nobody watches this object - just drop change flags, the fields will be sent within create block
+        // when somebody starts watching
+        if (m_watchers.empty() || !m_map)
+            memset(m_updateFieldsChangeBits, 0, sizeof(uint32_t) * (1 + (m_maxUpdateFieldIndex / 32)));
+        else
+            CaptureUpdate(m_map->GetSnapshot());
 
         m_updateFieldsNeedsUpdate = false;
     }
 }
 
-void WorldObject::BuildUpdatePacketBlock(SmartPacket &pkt)
+void WorldObject::CaptureUpdate(WorldSnapshot &snapshot)
 {
-    // write GUID to allow client to identify one specific object
-    pkt.WriteUInt64(GetGUID());
-
-    uint16_t pos = pkt.GetWritePos();
-    // placeholder for count
-    pkt.WriteUInt8(0);
+    snapshot.BeginObject(GetGUID());
 
-    uint8_t fieldCount = 0;
-
-    // go through all updatefields, determine if they need to be updated, and send those who do
+    // go through all updatefields, determine if they need to be updated, and capture those who do
     for (uint32_t pos = 0; pos < m_maxUpdateFieldIndex; pos++)
     {
         if ((m_updateFieldsChangeBits[pos / 32] & (1 << (pos % 32))) != 0)
         {
-            // write field that needs update
-            pkt.WriteUInt32(pos);
-            pkt.WriteUInt32(m_updateFields[pos]);
+            snapshot.AddField(pos, m_updateFields[pos]);
 
             // clear that bit
             m_updateFieldsChangeBits[pos / 32] &= ~(1 << (pos % 32));
-
-            // increase count to be written to packet
-            fieldCount++;
         }
     }
 
-    // finally write field count
-    pkt.WriteUInt8At(fieldCount, pos);
+    // the snapshot is sent after the update, watchers may be gone by then; sessions outlive them
+    for (Player* plr : m_watchers)
+        snapshot.AddRecipient(plr->GetSession());
 }
 
 void WorldObject::BuildCreatePacketBlock(SmartPacket &pkt)
 {
-    // write GUID (although it's in updatefields, we need the client
-    // to be able to create the object before setting fields)
-    pkt.WriteUInt64(GetGUID());
+    // serialize fields again only when some of them changed since the last time
+    if (!m_createBlockCacheValid)
+    {
+        SmartPacket block;
 
-    // field count
-    pkt.WriteUInt32(m_maxUpdateFieldIndex);
+        // write GUID (although it's in updatefields, we need the client
+        // to be able to create the object before setting fields)
+        block.WriteUInt64(GetGUID());
 
-    // field contents
-    for (uint32_t pos = 0; pos < m_maxUpdateFieldIndex; pos++)
-        pkt.WriteUInt32(m_updateFields[pos]);
+        // field count
+        block.WriteUInt32(m_maxUpdateFieldIndex);
+
+        // field contents
+        for (uint32_t pos = 0; pos < m_maxUpdateFieldIndex; pos++)
+            block.WriteUInt32(m_updateFields[pos]);
+
+        m_createBlockCache.assign(block.GetData(), block.GetData() + block.GetSize());
+        m_createBlockCacheValid = true;
+    }
+
+    // child classes append volatile data (position, etc.) after this part
+    pkt.WriteData(m_createBlockCache.data(), m_createBlockCache.size());
 }
 
 uint64_t WorldObject::GetGUID()
@@ -147,13 +158,48 @@ void WorldObject::SetUpdateFieldUpdateNeeded(uint32_t field)
 {
     m_updateFieldsChangeBits[field / 32] |= 1 << (field % 32);
     m_updateFieldsNeedsUpdate = true;
+    m_createBlockCacheValid = false;
 }
 
 void WorldObject::SendPacketToSorroundings(SmartPacket &pkt)
 {
-    Map* m = sMapManager->GetMap(GetMapId());
-    if (m)
-        m->SendPacketToSorroundings(GetPositionX(), GetPositionY(), pkt);
+    for (Player* plr : m_watchers)
+        plr->SendPacketToMe(pkt);
+}
+
+void WorldObject::AddWatcher(Player* plr)
+{
+    if (m_watchers.insert(plr).second)
+        plr->AddVisibleObject(this);
+}
+
+void WorldObject::RemoveWatcher(Player* plr)
+{
+    if (m_watchers.erase(plr) > 0)
+        plr->RemoveVisibleObject(this);
+}
+
+void WorldObject::ClearWatchers()
+{
+    for (Player* plr : m_watchers)
+        plr->RemoveVisibleObject(this);
+
+    m_watchers.clear();
+}
+
+bool WorldObject::HasWatchers()
+{
+    return !m_watchers.empty();
+}
+
+bool WorldObject::IsWatchedBy(Player* plr)
+{
+    return m_watchers.find(plr) != m_watchers.end();
+}
+
+WatcherSet const& WorldObject::GetWatchers()
+{
+    return m_watchers;
 }
 
 void WorldObject::SetUInt32Value(uint32_t field, uint32_t value)
@@ -276,39 +322,102 @@ uint32_t WorldObject::GetMapId()
     return m_positionMap;
 }
 
+uint32_t WorldObject::GetInstanceId()
+{
+    return m_positionInstance;
+}
+
 Map* WorldObject::GetMap()
 {
-    return sMapManager->GetMap(m_positionMap);
+    return m_map;
 }
 
-void WorldObject::RelocateWithinMap(float x, float y)
+void WorldObject::SetMap(Map* map)
+{
+    m_map = map;
+}
+
+void WorldObject::SetMapCellSlot(uint32_t slot)
+{
+    m_mapCellSlot = slot;
+}
+
+uint32_t WorldObject::GetMapCellSlot()
+{
+    return m_mapCellSlot;
+}
+
+void WorldObject::SetVisibilityUpdatePosition(Position const& pos)
+{
+    m_visibilityUpdatePosition = pos;
+}
+
+Position const& WorldObject::GetVisibilityUpdatePosition()
 {
-    Map* map = sMapManager->GetMap(m_positionMap);
-    map->Relocate(this, m_position.x, m_position.y, x, y);
+    return m_visibilityUpdatePosition;
+}
 
+void WorldObject::RelocateWithinMap(float x, float y)
+{
+    // set position first, the map uses it to determine visibility
+    Position oldPos = m_position;
     SetPosition(x, y);
+
+    if (m_map)
+        m_map->Relocate(this, oldPos.x, oldPos.y, x, y);
 }
 
-void WorldObject::TeleportTo(uint32_t mapId, float x, float y)
+void WorldObject::TeleportTo(uint32_t mapId, float x, float y, uint32_t instanceId)
 {
-    if (m_positionMap == mapId)
+    if (m_positionMap == mapId && m_positionInstance == instanceId)
     {
         RelocateWithinMap(x, y);
         return;
     }
 
-    // TODO: remove from old map, add to new map
-    Map* map = sMapManager->GetMap(m_positionMap);
-    map->RemoveFromMap(this);
+    if (!sMapManager->CanEnterMap(mapId, instanceId))
+    {
+        sLog->Error("Attempted to teleport object to map %u (instance %u), that doesn't exist", mapId, instanceId);
+        return;
+    }
+
+    // players may wait for the map to be loaded in background, other objects need it right now; the map
+    // could fail to load, so the object has to stay in its current map until then
+    Map* map = nullptr;
+    if (GetType() != OTYPE_PLAYER)
+    {
+        map = sMapManager->GetMap(mapId, instanceId);
+        if (!map)
+        {
+            sLog->Error("Could not teleport object to map %u (instance %u), the map failed to load", mapId, instanceId);
+            return;
+        }
+    }
+
+    // the object may not be in map yet, i.e. player waiting for map to be loaded
+    if (m_map)
+        m_map->RemoveFromMap(this);
+
+    // the new map uses stored map and position, so they need to be updated before adding
+    m_positionMap = mapId;
+    m_positionInstance = instanceId;
+    SetPosition(x, y);
 
-    map = sMapManager->GetMap(mapId);
-    map->AddToMap(this);
-    RelocateWithinMap(x, y);
+    if (GetType() == OTYPE_PLAYER)
+        sMapManager->AddPlayerToMap(ToPlayer());
+    else
+    {
+        // the target map may be updated by another thread
+        map->PostCommand([map, this]() {
+            map->AddToMap(this);
+        });
+    }
 }
 
-void WorldObject::SetInitialPositionAfterLoad(uint32_t mapId, float x, float y)
+void WorldObject::SetInitialPositionAfterLoad(uint32_t mapId, float x, float y, uint32_t instanceId)
 {
     m_positionMap = mapId;
+    m_positionInstance = instanceId;
     SetPosition(x, y);
 }
 
@@ -21,7 +21,11 @@
 #define BW_WORLDOBJECT_H
 
 #include "UpdateFields.h"
+
+// count of updatefield "needs update" flag words for given updatefield count
+#define UPDATEFIELD_CHANGEBITS_SIZE(count) (1 + ((count) / 32))
 #include "ObjectEnums.h"
+#include "MapEnums.h"
 
 #include <math.h>
 
@@ -80,6 +84,9 @@ class Player;
 class Creature;
 class SmartPacket;
 class Map;
+class WorldSnapshot;
+
+typedef std::set<Player*> WatcherSet;
 
 /*
  * Base class for all objects in world
@@ -95,8 +102,8 @@ class WorldObject
         virtual void Update();
         // builds create packet block to be sent to player
         virtual void BuildCreatePacketBlock(SmartPacket &pkt);
-        // builds update packet block to be sent to player
-        virtual void BuildUpdatePacketBlock(SmartPacket &pkt);
+        // captures changed updatefields and their watchers to snapshot, that is sent after map update
+        virtual void CaptureUpdate(WorldSnapshot &snapshot);
 
         // retrieves object GUID
         uint64_t GetGUID();
@@ -150,9 +157,22 @@ class WorldObject
 
         // sets flag for updating specified field
         void SetUpdateFieldUpdateNeeded(uint32_t field);
-        // send packet to sorrounding
+        // send packet to sorrounding (all players watching this object)
         void SendPacketToSorroundings(SmartPacket &pkt);
 
+        // adds player to watchers of this object
+        void AddWatcher(Player* plr);
+        // removes player from watchers of this object
+        void RemoveWatcher(Player* plr);
+        // removes all watchers of this object
+        void ClearWatchers();
+        // is there any player watching this object?
+        bool HasWatchers();
+        // is this object watched by specified player?
+        bool IsWatchedBy(Player* plr);
+        // retrieves set of players watching this object
+        WatcherSet const& GetWatchers();
+
         // sets position X coordinate
         void SetPositionX(float x);
         // sets position Y coordinate
@@ -167,15 +187,27 @@ class WorldObject
         float GetPositionY();
         // retrieves current map ID
         uint32_t GetMapId();
-        // retrieves current map
+        // retrieves current map instance ID
+        uint32_t GetInstanceId();
+        // retrieves current map; nullptr if the object is not in any map
         Map* GetMap();
+        // sets map the object was added to; used by map only
+        void SetMap(Map* map);
+        // sets index of object within its map cell; used by map only
+        void SetMapCellSlot(uint32_t slot);
+        // retrieves index of object within its map cell
+        uint32_t GetMapCellSlot();
+        // sets position, where the object visibility was updated last time
+        void SetVisibilityUpdatePosition(Position const& pos);
+        // retrieves position, where the object visibility was updated last time
+        Position const& GetVisibilityUpdatePosition();
 
         // relocates object within map
         void RelocateWithinMap(float x, float y);
-        // teleports object to another map
-        void TeleportTo(uint32_t mapId, float x, float y);
+        // teleports object to another map (or its instance)
+        void TeleportTo(uint32_t mapId, float x, float y, uint32_t instanceId = MAP_BASE_INSTANCE_ID);
         // sets position within map after loading process complete
-        void SetInitialPositionAfterLoad(uint32_t mapId, float x, float y);
+        void SetInitialPositionAfterLoad(uint32_t mapId, float x, float y, uint32_t instanceId = MAP_BASE_INSTANCE_ID);
         // retrieves current object image
         uint32_t GetImageId();
         // sets object image
@@ -199,11 +231,15 @@ class WorldObject
 
         // current map ID
         uint32_t m_positionMap;
+        // current map instance ID
+        uint32_t m_positionInstance;
         // current position
         Position m_position;
-        // object updatefields
+        // map the object is currently in
+        Map* m_map;
+        // object updatefields; the storage is owned by child class
         uint32_t* m_updateFields;
-        // object updatefields "needs update" flags
+        // object updatefields "needs update" flags; the storage is owned by child class
         uint32_t* m_updateFieldsChangeBits;
         // maximum updatefield index
         uint32_t m_maxUpdateFieldIndex;
@@ -212,10 +248,20 @@ class WorldObject
         ObjectType m_objectType;
         // object name
         std::string m_name;
+        // players watching this object (having this object created on client side)
+        WatcherSet m_watchers;
+        // index of object within its map cell
+        uint32_t m_mapCellSlot;
+        // position of last visibility update
+        Position m_visibilityUpdatePosition;
 
     private:
         // is there any updatefield update needed to be broadcast?
         bool m_updateFieldsNeedsUpdate;
+        // serialized GUID and updatefields part of create block
+        std::vector<uint8_t> m_createBlockCache;
+        // does the create block cache match current updatefields?
+        bool m_createBlockCacheValid;
 };
 
 #endif
@@ -0,0 +1,131 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "ChecksumCache.h"
+#include "Log.h"
+
+#include <fstream>
+
+ChecksumCache::ChecksumCache()
+{
+    m_changed = false;
+}
+
+ChecksumCache::~ChecksumCache()
+{
+    //
+}
+
+void ChecksumCache::Load(const char* path)
+{
+    std::unique_lock<std::mutex> lock(m_recordMutex);
+
+    m_path = path;
+    m_records.clear();
+    m_changed = false;
+
+    if (m_path.empty())
+        return;
+
+    std::ifstream f(m_path.c_str());
+    // the cache does not have to exist yet
+    if (!f.is_open())
+        return;
+
+    std::string line;
+    size_t pos1, pos2, pos3;
+    ChecksumCacheRecord rec;
+
+    // one record per line, format: key<TAB>file size<TAB>modification time<TAB>checksum
+    while (std::getline(f, line))
+    {
+        pos3 = line.rfind('\t');
+        pos2 = (pos3 != std::string::npos && pos3 > 0) ? line.rfind('\t', pos3 - 1) : std::string::npos;
+        pos1 = (pos2 != std::string::npos && pos2 > 0) ? line.rfind('\t', pos2 - 1) : std::string::npos;
+
+        if (pos1 == std::string::npos || pos1 == 0)
+        {
+            sLog->Error("Invalid checksum cache record: %s", line.c_str());
+            continue;
+        }
+
+        rec.fileSize = strtoull(line.substr(pos1 + 1, pos2 - pos1 - 1).c_str(), nullptr, 10);
+        rec.fileModifyTime = strtoull(line.substr(pos2 + 1, pos3 - pos2 - 1).c_str(), nullptr, 10);
+        rec.checksum = line.substr(pos3 + 1);
+        str_trim(rec.checksum);
+
+        m_records[line.substr(0, pos1)] = rec;
+    }
+
+    sLog->Info("Loaded %u cached checksums", (uint32_t)m_records.size());
+}
+
+void ChecksumCache::Save()
+{
+    std::unique_lock<std::mutex> lock(m_recordMutex);
+
+    if (m_path.empty() || !m_changed)
+        return;
+
+    std::ofstream f(m_path.c_str(), std::ios::out | std::ios::trunc);
+    if (!f.is_open())
+    {
+        sLog->Error("Could not write checksum cache file %s", m_path.c_str());
+        return;
+    }
+
+    for (ChecksumCacheMap::iterator itr = m_records.begin(); itr != m_records.end(); ++itr)
+        f << itr->first << '\t' << itr->second.fileSize << '\t' << itr->second.fileModifyTime << '\t' << itr->second.checksum << '\n';
+
+    m_changed = false;
+}
+
+bool ChecksumCache::Lookup(const std::string& key, uint64_t fileSize, uint64_t fileModifyTime, std::string& checksum)
+{
+    std::unique_lock<std::mutex> lock(m_recordMutex);
+
+    ChecksumCacheMap::iterator itr = m_records.find(key);
+    if (itr == m_records.end())
+        return false;
+
+    // the file has changed since checksum calculation
+    if (itr->second.fileSize != fileSize || itr->second.fileModifyTime != fileModifyTime)
+        return false;
+
+    checksum = itr->second.checksum;
+    return true;
+}
+
+void ChecksumCache::Store(const std::string& key, uint64_t fileSize, uint64_t fileModifyTime, const std::string& checksum)
+{
+    std::unique_lock<std::mutex> lock(m_recordMutex);
+
+    if (m_path.empty())
+        return;
+
+    ChecksumCacheRecord& rec = m_records[key];
+    if (rec.fileSize == fileSize && rec.fileModifyTime == fileModifyTime && rec.checksum == checksum)
+        return;
+
+    rec.fileSize = fileSize;
+    rec.fileModifyTime = fileModifyTime;
+    rec.checksum = checksum;
+    m_changed = true;
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://kennny.cz>
+ *
+ * This file is part of BubbleWorld MMORPG engine
+ *
+ * BubbleWorld is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * BubbleWorld is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with BubbleWorld. If not, see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef BW_CHECKSUMCACHE_H
+#define BW_CHECKSUMCACHE_H
+
+#include "Singleton.h"
+
+/*
+ * Structure of cached checksum record
+ */
+struct ChecksumCacheRecord
+{
+    // size of source file at the time of checksum calculation
+    uint64_t fileSize;
+    // modification time of source file at the time of checksum calculation
+    uint64_t fileModifyTime;
+    // calculated checksum
+    std::string checksum;
+};
+
+typedef std::map<std::string, ChecksumCacheRecord> ChecksumCacheMap;
+
+/*
+ * Singleton class maintaining checksums calculated during previous runs, so unchanged files don't need to be read again
+ */
+class ChecksumCache
+{
+    friend class Singleton<ChecksumCache>;
+    public:
+        ~ChecksumCache();
+
+        // loads cache from file; empty path disables caching
+        void Load(const char* path);
+        // saves cache to file, if anything changed since last save
+        void Save();
+
+        // retrieves cached checksum of key, if the file it was calculated from did not change; returns true if found
+        bool Lookup(const std::string& key, uint64_t fileSize, uint64_t fileModifyTime, std::string& checksum);
+        // stores calculated checksum of key
+        void Store(const std::string& key, uint64_t fileSize, uint64_t fileModifyTime, const std::string& checksum);
+
+    protected:
+        // protected singleton constructor
+        ChecksumCache();
+
+    private:
+        // cache file path
+        std::string m_path;
+        // cached records; key = file path, optionally with suffix identifying part of file
+        ChecksumCacheMap m_records;
+        // was there any change since last load/save?
+        bool m_changed;
+        // lock for records, checksums may be calculated from several threads
+        std::mutex m_recordMutex;
+};
+
+#define sChecksumCache Singleton<ChecksumCache>::getInstance()
+
+#endif
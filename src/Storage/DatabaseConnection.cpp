@@ -202,6 +202,8 @@ bool DatabaseConnection::Connect(const char* host, uint16_t port, const char* us
 
 DBResult DatabaseConnection::Query(const char* qr)
 {
+    std::unique_lock<std::mutex> lck(m_queryMutex);
+
     if (mysql_query(&m_connection, qr) == 0)
         return mysql_store_result(&m_connection);
 
@@ -222,6 +224,8 @@ DBResult DatabaseConnection::PQuery(const char* qr, ...)
 
 void DatabaseConnection::Execute(const char* qr)
 {
+    std::unique_lock<std::mutex> lck(m_queryMutex);
+
     if (mysql_query(&m_connection, qr) == 0)
         return;
 
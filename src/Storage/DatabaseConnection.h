@@ -107,6 +107,8 @@ class DatabaseConnection
     protected:
         // stored MySQL DB connection
         MYSQL m_connection;
+        // the connection is shared by main and map loader thread
+        std::mutex m_queryMutex;
 
     private:
         //
@@ -21,6 +21,9 @@
 #include "MapStorage.h"
 #include "DatabaseConnection.h"
 #include "CRC32.h"
+#include "ChecksumCache.h"
+#include "PathfindLayer.h"
+#include "Config.h"
 #include "Log.h"
 
 #include <sstream>
@@ -33,7 +36,8 @@ MapStorage::MapStorage()
 
 MapStorage::~MapStorage()
 {
-    //
+    for (MapMap::iterator itr = m_maps.begin(); itr != m_maps.end(); ++itr)
+        UnloadMapFile(&itr->second);
 }
 
 void MapStorage::LoadFromDB()
@@ -56,10 +60,22 @@ void MapStorage::LoadFromDB()
     sLog->Info("Loaded %u map records", count);
     sLog->Info("");
 
+    // load map contents; chunk storage is sized by map header
+    sLog->Info(">> Loading maps...");
+    count = 0;
+    for (MapMap::iterator itr = m_maps.begin(); itr != m_maps.end(); ++itr)
+    {
+        LoadMap(itr->first);
+        count++;
+    }
+    sLog->Info("Loaded %u maps", count);
+    sLog->Info("");
+
     // load map chunk records
     sLog->Info(">> Loading map chunk cache...");
     DBResult res2 = sMainDatabase.Query("SELECT map_id, start_x, start_y, size_x, size_y, checksum FROM map_chunk;");
     count = 0;
+    MapChunkRecord* mch;
     while (res2.FetchRow())
     {
         id = res2.GetUInt32(0);
@@ -69,27 +85,22 @@ void MapStorage::LoadFromDB()
         cx = GetChunkIndexX(sx);
         cy = GetChunkIndexY(sy);
 
-        m_maps[id].chunks[cx][cy].mapId = id;
-        m_maps[id].chunks[cx][cy].startX = sx;
-        m_maps[id].chunks[cx][cy].startY = sy;
-        m_maps[id].chunks[cx][cy].sizeX = res2.GetUInt32(3);
-        m_maps[id].chunks[cx][cy].sizeY = res2.GetUInt32(4);
+        // chunks outside loaded maps are not present anymore
+        if (m_maps.find(id) == m_maps.end() || !(mch = m_maps[id].GetChunk(cx, cy)))
+            continue;
 
-        m_maps[id].chunks[cx][cy].checksum = res2.GetString(5).c_str();
-        count++;
-    }
-    sLog->Info("Loaded %u cached map chunks", count);
-    sLog->Info("");
+        // cached size is used for checksums and chunk packets, it can't exceed chunk storage
+        mch->sizeX = res2.GetUInt32(3);
+        if (mch->sizeX > MAP_CHUNK_SIZE_X)
+            mch->sizeX = MAP_CHUNK_SIZE_X;
+        mch->sizeY = res2.GetUInt32(4);
+        if (mch->sizeY > MAP_CHUNK_SIZE_Y)
+            mch->sizeY = MAP_CHUNK_SIZE_Y;
 
-    // load map contents
-    sLog->Info(">> Loading maps...");
-    count = 0;
-    for (MapMap::iterator itr = m_maps.begin(); itr != m_maps.end(); ++itr)
-    {
-        LoadMap(itr->first);
+        mch->checksum = res2.GetString(5).c_str();
         count++;
     }
-    sLog->Info("Loaded %u maps", count);
+    sLog->Info("Loaded %u cached map chunks", count);
     sLog->Info("");
 }
 
@@ -105,63 +116,329 @@ void MapStorage::LoadMap(uint32_t id)
 
     std::string path = std::string(DATA_DIR) + rec->filename;
 
+    // only header is loaded now, chunks are loaded on first access
+    LoadMapFile(rec, path.c_str());
+}
+
+bool MapStorage::LoadMapFile(MapRecord* rec, const char* path)
+{
+    UnloadMapFile(rec);
+
     // open map file for reading
-    FILE* f = fopen(path.c_str(), "rb");
+    FILE* f = fopen(path, "rb");
     if (!f)
     {
-        sLog->Error("Cannot open map file %s for reading!", path.c_str());
-        return;
+        sLog->Error("Cannot open map file %s for reading!", path);
+        return false;
+    }
+
+    // file info is used to determine, if cached chunk checksums are still valid
+    if (!custom_getFileInfo(path, rec->fileSize, rec->fileModifyTime))
+    {
+        rec->fileSize = 0;
+        rec->fileModifyTime = 0;
     }
 
     // clear header and load it from file
     memset(&rec->header, 0, sizeof(MapHeader));
     fread(&rec->header, sizeof(MapHeader), 1, f);
 
-    // verify map file magic
-    if (rec->header.mapVersionMagic != MAP_VERSION_MAGIC)
+    rec->chunkCountX = GetChunkIndexX(rec->header.sizeX + MAP_CHUNK_SIZE_X - 1);
+    rec->chunkCountY = GetChunkIndexY(rec->header.sizeY + MAP_CHUNK_SIZE_Y - 1);
+
+    bool result;
+
+    // verify map file magic; column format file stays opened, chunk-blocked file is mapped
+    if (rec->header.mapVersionMagic == MAP_VERSION_MAGIC)
+    {
+        rec->columnFile = f;
+        result = true;
+    }
+    else if (rec->header.mapVersionMagic == MAP_VERSION_MAGIC_V2)
     {
-        sLog->Error("Unsupported map format file %s (ID: %u)", path.c_str(), id);
         fclose(f);
-        return;
+
+        result = MapChunkBlocks(rec, path);
+
+        // header checksum does not depend on file format
+        rec->header.mapVersionMagic = MAP_VERSION_MAGIC;
+    }
+    else
+    {
+        fclose(f);
+        sLog->Error("Unsupported map format file %s (ID: %u)", path, rec->id);
+        result = false;
+    }
+
+    if (!result)
+    {
+        UnloadMapFile(rec);
+        rec->chunkCountX = 0;
+        rec->chunkCountY = 0;
+        return false;
+    }
+
+    PrepareChunks(rec);
+
+    return true;
+}
+
+bool MapStorage::MapChunkBlocks(MapRecord* rec, const char* path)
+{
+    rec->mappedFile = new MappedFile();
+    if (!rec->mappedFile->Open(path))
+    {
+        sLog->Error("Cannot map file %s to memory!", path);
+        return false;
+    }
+
+    uint8_t* data = rec->mappedFile->GetData();
+    size_t size = rec->mappedFile->GetSize();
+
+    if (size < sizeof(MapHeader) + sizeof(MapFileLayout))
+    {
+        sLog->Error("Map file %s is truncated", path);
+        return false;
+    }
+
+    MapFileLayout layout;
+    memcpy(&layout, data + sizeof(MapHeader), sizeof(MapFileLayout));
+
+    // the layout has to match exactly, chunk blocks are used in place
+    if (layout.chunkCountX != rec->chunkCountX || layout.chunkCountY != rec->chunkCountY ||
+        layout.chunkSizeX != MAP_CHUNK_SIZE_X || layout.chunkSizeY != MAP_CHUNK_SIZE_Y ||
+        layout.fieldSize != sizeof(MapField) || (layout.dataOffset % MAP_FILE_DATA_ALIGNMENT) != 0)
+    {
+        sLog->Error("Map file %s has incompatible chunk layout", path);
+        return false;
     }
 
-    // load chunks
-    uint32_t cx, cy, ix, iy;
+    if (layout.dataOffset + (size_t)rec->chunkCountX * rec->chunkCountY * MAP_CHUNK_SIZE_X * MAP_CHUNK_SIZE_Y * sizeof(MapField) > size)
+    {
+        sLog->Error("Map file %s is truncated", path);
+        return false;
+    }
+
+    rec->chunkDataOffset = layout.dataOffset;
+
+    return true;
+}
+
+void MapStorage::PrepareChunks(MapRecord* rec)
+{
+    rec->chunks.resize(rec->chunkCountX * rec->chunkCountY);
+
     MapChunkRecord* mch;
-    for (uint32_t x = 0; x < rec->header.sizeX; x++)
+    for (uint32_t cx = 0; cx < rec->chunkCountX; cx++)
+    {
+        for (uint32_t cy = 0; cy < rec->chunkCountY; cy++)
+        {
+            mch = rec->GetChunk(cx, cy);
+
+            mch->mapId = rec->id;
+            mch->startX = GetChunkStartX(cx);
+            mch->startY = GetChunkStartY(cy);
+            mch->sizeX = MAP_CHUNK_SIZE_X;
+            if (mch->sizeX + mch->startX > rec->header.sizeX)
+                mch->sizeX = mch->sizeX + mch->startX - rec->header.sizeX;
+            mch->sizeY = MAP_CHUNK_SIZE_Y;
+            if (mch->sizeY + mch->startY > rec->header.sizeY)
+                mch->sizeY = mch->sizeY + mch->startY - rec->header.sizeY;
+            mch->checksum = "";
+
+            mch->fields = nullptr;
+            mch->pathfindPage = nullptr;
+            mch->refCount = 0;
+            mch->releaseTime = 0;
+            mch->checksumVerified = false;
+        }
+    }
+}
+
+bool MapStorage::LoadChunkFields(MapRecord* rec, MapChunkRecord* chunk)
+{
+    uint32_t cx = GetChunkIndexX(chunk->startX);
+    uint32_t cy = GetChunkIndexY(chunk->startY);
+
+    // chunk blocks are stored in the same order as chunk records, use them in place
+    if (rec->mappedFile)
+    {
+        MapField* fieldData = (MapField*)(rec->mappedFile->GetData() + rec->chunkDataOffset);
+        chunk->fields = (MapField(*)[MAP_CHUNK_SIZE_Y])(fieldData + (size_t)(cx * rec->chunkCountY + cy) * MAP_CHUNK_SIZE_X * MAP_CHUNK_SIZE_Y);
+        return true;
+    }
+
+    if (!rec->columnFile)
+        return false;
+
+    // fields outside map stay zeroed
+    chunk->fields = new MapField[MAP_CHUNK_SIZE_X][MAP_CHUNK_SIZE_Y];
+    memset(chunk->fields, 0, sizeof(MapField) * MAP_CHUNK_SIZE_X * MAP_CHUNK_SIZE_Y);
+
+    // fields are stored by columns (X outer, Y inner); read chunk's part of every column
+    uint32_t count = num_min(rec->header.sizeY - chunk->startY, (uint32_t)MAP_CHUNK_SIZE_Y);
+    for (uint32_t ix = 0; ix < MAP_CHUNK_SIZE_X && chunk->startX + ix < rec->header.sizeX; ix++)
+    {
+        if (fseek(rec->columnFile, (long)(sizeof(MapHeader) + ((size_t)(chunk->startX + ix) * rec->header.sizeY + chunk->startY) * sizeof(MapField)), SEEK_SET) != 0
+            || fread(chunk->fields[ix], sizeof(MapField), count, rec->columnFile) != count)
+        {
+            delete[] chunk->fields;
+            chunk->fields = nullptr;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void MapStorage::UnloadChunkFields(MapRecord* rec, MapChunkRecord* chunk)
+{
+    delete chunk->pathfindPage;
+    chunk->pathfindPage = nullptr;
+
+    // mapped chunks are owned by the mapping
+    if (!rec->mappedFile)
+        delete[] chunk->fields;
+    chunk->fields = nullptr;
+}
+
+void MapStorage::UnloadMapFile(MapRecord* rec)
+{
+    for (MapChunkRecord& mch : rec->chunks)
+        UnloadChunkFields(rec, &mch);
+    rec->chunks.clear();
+
+    if (rec->columnFile)
+    {
+        fclose(rec->columnFile);
+        rec->columnFile = nullptr;
+    }
+
+    if (rec->mappedFile)
+    {
+        delete rec->mappedFile;
+        rec->mappedFile = nullptr;
+    }
+}
+
+MapChunkRecord* MapStorage::AcquireChunk(MapRecord* rec, uint32_t chunkX, uint32_t chunkY)
+{
+    MapChunkRecord* mch = rec->GetChunk(chunkX, chunkY);
+    if (!mch)
+        return nullptr;
+
+    // load chunk on first access
+    if (!mch->fields)
+    {
+        if (!LoadChunkFields(rec, mch))
+        {
+            sLog->Error("Cannot load map (ID: %u) chunk [%u : %u]", rec->id, chunkX, chunkY);
+            return nullptr;
+        }
+
+        if (!mch->checksumVerified)
+            VerifyChunkChecksum(rec, mch);
+
+        mch->pathfindPage = PathfindLayer::BuildBasePage(rec, mch);
+    }
+
+    if (mch->refCount == 0)
+        m_unusedChunks.erase(mch);
+    mch->refCount++;
+
+    return mch;
+}
+
+void MapStorage::ReleaseChunk(MapChunkRecord* chunk)
+{
+    if (chunk->refCount == 0)
+        return;
+
+    if (--chunk->refCount == 0)
+    {
+        chunk->releaseTime = getMSTime();
+        m_unusedChunks.insert(chunk);
+    }
+}
+
+void MapStorage::UnloadUnusedChunks()
+{
+    uint32_t delay = (uint32_t)sConfig->GetIntValue(CONFIG_INT_MAP_CHUNK_UNLOAD_DELAY) * 1000;
+    uint32_t now = getMSTime();
+
+    for (std::set<MapChunkRecord*>::iterator itr = m_unusedChunks.begin(); itr != m_unusedChunks.end(); )
+    {
+        if (getMSTimeDiff((*itr)->releaseTime, now) >= delay)
+        {
+            UnloadChunkFields(&m_maps[(*itr)->mapId], *itr);
+            itr = m_unusedChunks.erase(itr);
+        }
+        else
+            ++itr;
+    }
+}
+
+bool MapStorage::ConvertMapFile(const char* source, const char* destination)
+{
+    MapRecord rec;
+    rec.id = 0;
+    rec.columnFile = nullptr;
+    rec.mappedFile = nullptr;
+
+    if (!LoadMapFile(&rec, source))
+        return false;
+
+    FILE* f = fopen(destination, "wb");
+    if (!f)
+    {
+        sLog->Error("Cannot open map file %s for writing!", destination);
+        UnloadMapFile(&rec);
+        return false;
+    }
+
+    MapHeader header = rec.header;
+    header.mapVersionMagic = MAP_VERSION_MAGIC_V2;
+
+    MapFileLayout layout;
+    layout.chunkCountX = rec.chunkCountX;
+    layout.chunkCountY = rec.chunkCountY;
+    layout.chunkSizeX = MAP_CHUNK_SIZE_X;
+    layout.chunkSizeY = MAP_CHUNK_SIZE_Y;
+    layout.fieldSize = sizeof(MapField);
+    layout.dataOffset = ((sizeof(MapHeader) + sizeof(MapFileLayout) + MAP_FILE_DATA_ALIGNMENT - 1) / MAP_FILE_DATA_ALIGNMENT) * MAP_FILE_DATA_ALIGNMENT;
+
+    fwrite(&header, sizeof(MapHeader), 1, f);
+    fwrite(&layout, sizeof(MapFileLayout), 1, f);
+
+    // pad to aligned chunk data
+    std::vector<uint8_t> padding(layout.dataOffset - sizeof(MapHeader) - sizeof(MapFileLayout), 0);
+    fwrite(padding.data(), 1, padding.size(), f);
+
+    // write chunk blocks one by one, including zeroed fields outside map
+    bool result = true;
+    for (MapChunkRecord& mch : rec.chunks)
     {
-        for (uint32_t y = 0; y < rec->header.sizeY; y++)
+        if (!LoadChunkFields(&rec, &mch))
         {
-            // get chunk indexes
-            cx = GetChunkIndexX(x);
-            cy = GetChunkIndexY(y);
-
-            // this will create the record before actual usage
-            if (rec->chunks.find(cx) == rec->chunks.end())
-                rec->chunks[cx].clear();
-            if (rec->chunks[cx].find(cy) == rec->chunks[cx].end())
-            {
-                rec->chunks[cx][cy].mapId = id;
-                rec->chunks[cx][cy].startX = cx * MAP_CHUNK_SIZE_X;
-                rec->chunks[cx][cy].startY = cy * MAP_CHUNK_SIZE_Y;
-                rec->chunks[cx][cy].sizeX = MAP_CHUNK_SIZE_X;
-                if (rec->chunks[cx][cy].sizeX + rec->chunks[cx][cy].startX > rec->header.sizeX)
-                    rec->chunks[cx][cy].sizeX = rec->chunks[cx][cy].sizeX + rec->chunks[cx][cy].startX - rec->header.sizeX;
-                rec->chunks[cx][cy].sizeY = MAP_CHUNK_SIZE_Y;
-                if (rec->chunks[cx][cy].sizeY + rec->chunks[cx][cy].startY > rec->header.sizeY)
-                    rec->chunks[cx][cy].sizeY = rec->chunks[cx][cy].sizeY + rec->chunks[cx][cy].startY - rec->header.sizeY;
-                rec->chunks[cx][cy].checksum = "";
-            }
-
-            mch = &rec->chunks[cx][cy];
-            ix = mch->GetFieldOffsetX(x);
-            iy = mch->GetFieldOffsetY(y);
-
-            // read field data
-            memset(&mch->fields[ix][iy], 0, sizeof(MapField));
-            fread(&mch->fields[ix][iy], sizeof(MapField), 1, f);
+            sLog->Error("Cannot read map file %s!", source);
+            result = false;
+            break;
         }
+
+        if (fwrite(mch.fields, sizeof(MapField) * MAP_CHUNK_SIZE_Y, MAP_CHUNK_SIZE_X, f) != MAP_CHUNK_SIZE_X)
+        {
+            sLog->Error("Cannot write map file %s!", destination);
+            result = false;
+            break;
+        }
+
+        UnloadChunkFields(&rec, &mch);
     }
+
+    fclose(f);
+    UnloadMapFile(&rec);
+
+    return result;
 }
 
 void MapStorage::VerifyChecksums()
@@ -181,34 +458,43 @@ void MapStorage::VerifyChecksums()
             sLog->Info("Updating checksum of %s to %s", itr->second.filename.c_str(), checksum.c_str());
             UpdateChecksumOfMap(itr->second.id, checksum.c_str());
         }
+    }
+}
 
-        // calculate checksum of all chunks
-        for (uint32_t cx = 0; cx < itr->second.chunks.size(); cx++)
-        {
-            for (uint32_t cy = 0; cy < itr->second.chunks[cx].size(); cy++)
-            {
-                crc = 0;
+void MapStorage::VerifyChunkChecksum(MapRecord* rec, MapChunkRecord* chunk)
+{
+    uint32_t crc = 0;
+    std::string checksum;
 
-                MapChunkRecord* mch = &itr->second.chunks[cx][cy];
+    uint32_t cx = GetChunkIndexX(chunk->startX);
+    uint32_t cy = GetChunkIndexY(chunk->startY);
 
-                // calculate checksum using fields within chunk
-                for (uint32_t ix = 0; ix < mch->sizeX; ix++)
-                    for (uint32_t iy = 0; iy < mch->sizeY; iy++)
-                        crc = CRC32_Bytes_Continuous((uint8_t*)&mch->fields[ix][iy], sizeof(MapField), crc);
+    // chunk is identified by map file path and its indexes
+    std::string cacheKey = std::string(DATA_DIR) + rec->filename + "#" + std::to_string(cx) + ":" + std::to_string(cy);
 
-                crc = CRC32_Bytes_ContinuousFinalize(crc);
+    // use cached checksum, if the map file did not change since its calculation
+    if (rec->fileSize == 0 || !sChecksumCache->Lookup(cacheKey, rec->fileSize, rec->fileModifyTime, checksum))
+    {
+        // calculate checksum using fields within chunk; fields in one column are stored contiguously
+        for (uint32_t ix = 0; ix < chunk->sizeX; ix++)
+            crc = CRC32_Bytes_Continuous((uint8_t*)chunk->fields[ix], sizeof(MapField) * chunk->sizeY, crc);
 
-                checksum = GetCRC32String(crc);
+        crc = CRC32_Bytes_ContinuousFinalize(crc);
 
-                // update if needed
-                if (checksum != mch->checksum)
-                {
-                    sLog->Info("Updating checksum of map (ID: %u) chunk [%u : %u] to %s", itr->first, cx, cy, checksum.c_str());
-                    UpdateChecksumOfMapChunk(itr->second.id, cx, cy, checksum.c_str());
-                }
-            }
-        }
+        checksum = GetCRC32String(crc);
+
+        if (rec->fileSize != 0)
+            sChecksumCache->Store(cacheKey, rec->fileSize, rec->fileModifyTime, checksum);
+    }
+
+    // update if needed
+    if (checksum != chunk->checksum)
+    {
+        sLog->Info("Updating checksum of map (ID: %u) chunk [%u : %u] to %s", rec->id, cx, cy, checksum.c_str());
+        UpdateChecksumOfMapChunk(rec->id, cx, cy, checksum.c_str());
     }
+
+    chunk->checksumVerified = true;
 }
 
 MapRecord* MapStorage::GetMapRecord(uint32_t id)
@@ -228,18 +514,22 @@ void MapStorage::UpdateChecksumOfMap(uint32_t id, const char* checksum)
 
 void MapStorage::UpdateChecksumOfMapChunk(uint32_t map_id, uint32_t ix, uint32_t iy, const char* checksum)
 {
+    MapChunkRecord* mch = m_maps[map_id].GetChunk(ix, iy);
+    if (!mch)
+        return;
+
     // not yet cached
-    if (m_maps[map_id].chunks[ix][iy].checksum == "")
+    if (mch->checksum == "")
     {
         sMainDatabase.PExecute("INSERT INTO map_chunk (map_id, start_x, start_y, size_x, size_y, checksum) \
-            VALUES (%u, %u, %u, %u, %u, '%s')", map_id, GetChunkStartX(ix), GetChunkStartY(iy), m_maps[map_id].chunks[ix][iy].sizeX, m_maps[map_id].chunks[ix][iy].sizeY, checksum);
+            VALUES (%u, %u, %u, %u, %u, '%s')", map_id, GetChunkStartX(ix), GetChunkStartY(iy), mch->sizeX, mch->sizeY, checksum);
     }
     else
     {
         sMainDatabase.PExecute("UPDATE map_chunk SET checksum = '%s' WHERE map_id = %u AND start_x = %u AND start_y = %u", checksum, map_id, GetChunkStartX(ix), GetChunkStartY(iy));
     }
 
-    m_maps[map_id].chunks[ix][iy].checksum = checksum;
+    mch->checksum = checksum;
 }
 
 uint32_t MapStorage::GetChunkIndexX(uint32_t startX)
@@ -23,6 +23,7 @@
 #include "Singleton.h"
 
 #include "MapEnums.h"
+#include "MappedFile.h"
 
 // force alignment to 4 bytes
 #if defined(__GNUC__)
@@ -58,14 +59,26 @@ struct MapField
     uint32_t flags;                         // field flags
 };
 
+/*
+ * Chunk-blocked map file layout, follows header in files with MAP_VERSION_MAGIC_V2
+ */
+struct MapFileLayout
+{
+    uint32_t chunkCountX;                   // chunk count in X direction
+    uint32_t chunkCountY;                   // chunk count in Y direction
+    uint32_t chunkSizeX;                    // field count per chunk in X direction
+    uint32_t chunkSizeY;                    // field count per chunk in Y direction
+    uint32_t fieldSize;                     // size of field structure
+    uint32_t dataOffset;                    // offset of first chunk block (aligned to MAP_FILE_DATA_ALIGNMENT)
+};
+
 #if defined(__GNUC__)
 #pragma pack()
 #else
 #pragma pack(pop)
 #endif
 
-typedef std::map<uint32_t, MapField> MapFieldRow;
-typedef std::map<uint32_t, MapFieldRow> MapFieldMap;
+struct PathfindPage;
 
 /*
  * Structure for one map chunk
@@ -87,8 +100,17 @@ struct MapChunkRecord
 
     // runtime generated/loaded data
 
-    // stored fields
-    MapFieldMap fields;
+    // stored fields; key1 = X offset, key2 = Y offset, fields outside map are zeroed
+    // points to chunk's own storage, or directly to mapped map file; nullptr if not loaded
+    MapField (*fields)[MAP_CHUNK_SIZE_Y];
+    // base pathfinding page shared by all map instances; built when the chunk is loaded
+    PathfindPage* pathfindPage;
+    // count of references held by maps or handlers
+    uint32_t refCount;
+    // time when the last reference was released
+    uint32_t releaseTime;
+    // was the checksum verified against chunk contents?
+    bool checksumVerified;
 
     // retrieves field X offset within chunk using absolute X coordinate
     uint32_t GetFieldOffsetX(uint32_t absX)
@@ -102,8 +124,7 @@ struct MapChunkRecord
     }
 };
 
-typedef std::map<uint32_t, MapChunkRecord> MapChunkRow;
-typedef std::map<uint32_t, MapChunkRow> MapChunkMap;
+typedef std::vector<MapChunkRecord> MapChunkVector;
 
 /*
  * Structure containing information about map database record
@@ -121,8 +142,40 @@ struct MapRecord
 
     // map header loaded from file
     MapHeader header;
-    // chunk map
-    MapChunkMap chunks;
+    // chunk count in X direction
+    uint32_t chunkCountX;
+    // chunk count in Y direction
+    uint32_t chunkCountY;
+    // chunks; index = chunkX * chunkCountY + chunkY
+    MapChunkVector chunks;
+    // opened map file in column format; chunks are read from it on demand
+    FILE* columnFile;
+    // mapped chunk-blocked map file
+    MappedFile* mappedFile;
+    // offset of first chunk block within mapped file
+    uint32_t chunkDataOffset;
+    // size of loaded map file; 0 if unknown
+    uint64_t fileSize;
+    // modification time of loaded map file
+    uint64_t fileModifyTime;
+
+    // retrieves chunk using its indexes, nullptr if out of bounds
+    MapChunkRecord* GetChunk(uint32_t chunkX, uint32_t chunkY)
+    {
+        if (chunkX >= chunkCountX || chunkY >= chunkCountY)
+            return nullptr;
+
+        return &chunks[chunkX * chunkCountY + chunkY];
+    }
+    // retrieves field using absolute coordinates, nullptr if out of map or the chunk is not loaded
+    MapField* GetField(uint32_t x, uint32_t y)
+    {
+        MapChunkRecord* chunk = GetChunk(x / MAP_CHUNK_SIZE_X, y / MAP_CHUNK_SIZE_Y);
+        if (!chunk || !chunk->fields || x >= header.sizeX || y >= header.sizeY)
+            return nullptr;
+
+        return &chunk->fields[x % MAP_CHUNK_SIZE_X][y % MAP_CHUNK_SIZE_Y];
+    }
 };
 
 typedef std::map<uint32_t, MapRecord> MapMap;
@@ -138,12 +191,22 @@ class MapStorage
 
         // load map records from database
         void LoadFromDB();
-        // verify checksums of maps and their chunks
+        // verify checksums of map headers; chunk checksums are verified when the chunk is loaded
         void VerifyChecksums();
 
         // retrieves map record
         MapRecord* GetMapRecord(uint32_t id);
 
+        // retrieves chunk and keeps it loaded until released; loads the chunk if needed, nullptr on failure
+        MapChunkRecord* AcquireChunk(MapRecord* rec, uint32_t chunkX, uint32_t chunkY);
+        // releases chunk reference; unreferenced chunks are unloaded after configured delay
+        void ReleaseChunk(MapChunkRecord* chunk);
+        // unloads chunks, that are no longer referenced for configured delay
+        void UnloadUnusedChunks();
+
+        // converts map file to chunk-blocked format, that could be mapped to memory
+        static bool ConvertMapFile(const char* source, const char* destination);
+
         // retrieves chunk X index using starting coordinate
         static uint32_t GetChunkIndexX(uint32_t startX);
         // retrieves chunk Y index using starting coordinate
@@ -162,12 +225,29 @@ class MapStorage
         // updates checksum of map chunk contents in database
         void UpdateChecksumOfMapChunk(uint32_t map_id, uint32_t start_x, uint32_t start_y, const char* checksum);
 
-        // loads map from file
+        // loads map header from file and prepares its chunks
         void LoadMap(uint32_t id);
+        // verifies chunk checksum using its contents, and updates it if needed
+        void VerifyChunkChecksum(MapRecord* rec, MapChunkRecord* chunk);
+
+        // opens map file and prepares chunk records of map record; chunk contents are loaded on demand; returns true on success
+        static bool LoadMapFile(MapRecord* rec, const char* path);
+        // maps chunk-blocked map file to memory and validates its layout
+        static bool MapChunkBlocks(MapRecord* rec, const char* path);
+        // prepares chunk records of map record, without contents
+        static void PrepareChunks(MapRecord* rec);
+        // loads chunk contents from map file; returns true on success
+        static bool LoadChunkFields(MapRecord* rec, MapChunkRecord* chunk);
+        // unloads chunk contents and its base pathfinding page
+        static void UnloadChunkFields(MapRecord* rec, MapChunkRecord* chunk);
+        // closes map file and releases all chunks of map record
+        static void UnloadMapFile(MapRecord* rec);
 
     private:
         // all loaded maps
         MapMap m_maps;
+        // loaded chunks without references
+        std::set<MapChunkRecord*> m_unusedChunks;
 };
 
 #define sMapStorage Singleton<MapStorage>::getInstance()
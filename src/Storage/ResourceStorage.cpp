@@ -21,6 +21,8 @@
 #include "ResourceStorage.h"
 #include "DatabaseConnection.h"
 #include "CRC32.h"
+#include "ThreadPool.h"
+#include "ChecksumCache.h"
 #include "Log.h"
 
 #include <sstream>
@@ -118,32 +120,65 @@ void ResourceStorage::VerifyChecksums()
     ResourceRecord* rec;
     ImageResourceMetadata* meta;
     ImageAnimationMetadata* animmeta;
-    FILE* f;
     uint32_t crc;
     std::string checksum;
+    size_t i;
 
-    // calculate and verify checksums of all resource files
+    std::vector<ResourceRecord*> records;
     for (ResourceMap::iterator itr = m_resources[RSTYPE_IMAGE].begin(); itr != m_resources[RSTYPE_IMAGE].end(); ++itr)
+        records.push_back(&itr->second);
+
+    // results of checksum calculation; empty string means the file could not be opened
+    std::vector<std::string> checksums(records.size());
+
+    // calculate checksums of all changed resource files in parallel
     {
-        rec = &itr->second;
+        ThreadPool pool;
 
-        f = fopen((std::string(DATA_DIR) + rec->filename).c_str(), "rb");
-        if (f)
+        for (i = 0; i < records.size(); i++)
         {
-            checksum = GetCRC32String(CRC32_File(f));
+            pool.Enqueue([&records, &checksums, i]() {
+                std::string path = std::string(DATA_DIR) + records[i]->filename;
+                uint64_t fileSize, fileModifyTime;
+
+                if (!custom_getFileInfo(path.c_str(), fileSize, fileModifyTime))
+                    return;
+
+                // file did not change since last calculation
+                if (sChecksumCache->Lookup(path, fileSize, fileModifyTime, checksums[i]))
+                    return;
+
+                FILE* f = fopen(path.c_str(), "rb");
+                if (f)
+                {
+                    checksums[i] = GetCRC32String(CRC32_File(f));
+                    fclose(f);
+
+                    sChecksumCache->Store(path, fileSize, fileModifyTime, checksums[i]);
+                }
+            });
+        }
 
-            // update if needed
-            if (checksum != rec->checksum)
-            {
-                sLog->Info("Updating checksum of %s to %s", rec->filename.c_str(), checksum.c_str());
-                UpdateChecksumOf(RSTYPE_IMAGE, rec->id, checksum.c_str());
-            }
+        pool.Wait();
+    }
 
-            fclose(f);
-        }
-        else
+    // verify checksums of all resource files; database is accessed only from this thread
+    for (i = 0; i < records.size(); i++)
+    {
+        rec = records[i];
+        checksum = checksums[i];
+
+        if (checksum.empty())
         {
             sLog->Error("Could not open resource %s", rec->filename.c_str());
+            continue;
+        }
+
+        // update if needed
+        if (checksum != rec->checksum)
+        {
+            sLog->Info("Updating checksum of %s to %s", rec->filename.c_str(), checksum.c_str());
+            UpdateChecksumOf(RSTYPE_IMAGE, rec->id, checksum.c_str());
         }
     }
 